@@ -0,0 +1,317 @@
+/**
+ * @file libprocdb.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief libprocdb is the client library of procdb - it talks to procdb-server via shared memory without any string formatting
+ *
+ * @details requests get submitted into a local queue of the connection and are handed to the server as soon as a request slot is free. procdb_poll, procdb_wait and procdb_wait_any collect the results, so one process can have many requests in flight. a connection must only be used by one thread at a time.
+ * every write starts a new epoch. reads and scans can ask for an older epoch as long as a pin (procdb_begin) holds it.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef LIBPROCDB_H
+#define LIBPROCDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief flag for procdb_connect - busy poll for responses with adaptive backoff instead of sleeping on a semaphore right away
+ */
+#define PROCDB_BUSY_POLL (1)
+
+/**
+ * @brief max number of requests of a connection that are submitted but not collected yet
+ */
+#define PROCDB_QUEUE_SIZE (64)
+
+/**
+ * @brief types of queries - value of a field of a process, command line of a process, aggregate of a field, several aggregates of several fields, insert, update or delete of a process, start of a watch and number of distinct command lines or pids
+ */
+#define PROCDB_QUERY_FIELD (1)
+#define PROCDB_QUERY_COMMAND (2)
+#define PROCDB_QUERY_AGGREGATE (3)
+#define PROCDB_QUERY_STATS (4)
+#define PROCDB_QUERY_INSERT (5)
+#define PROCDB_QUERY_UPDATE (6)
+#define PROCDB_QUERY_DELETE (7)
+#define PROCDB_QUERY_WATCH (8)
+#define PROCDB_QUERY_DISTINCT (9)
+
+/**
+ * @brief fields of a process - only cpu, mem and time can be aggregated or watched, only command and pid can be counted distinct
+ */
+#define PROCDB_CPU (0)
+#define PROCDB_MEM (1)
+#define PROCDB_TIME (2)
+#define PROCDB_COMMAND (3)
+#define PROCDB_PID (4)
+
+/**
+ * @brief number of time windows of one minute a distinct query can count in
+ */
+#define PROCDB_DISTINCT_WINDOWS (60)
+
+/**
+ * @brief aggregates - for PROCDB_QUERY_STATS they are used as bits of a bitmask (1 << PROCDB_MIN), as are the fields
+ */
+#define PROCDB_MIN (0)
+#define PROCDB_MAX (1)
+#define PROCDB_SUM (2)
+#define PROCDB_AVG (3)
+
+/**
+ * @brief conditions of a watch - value > threshold or value < threshold
+ */
+#define PROCDB_ABOVE (1)
+#define PROCDB_BELOW (2)
+
+/**
+ * @brief formats of a scan page - an array of struct procdb_row or lines like in the input-file of the server
+ */
+#define PROCDB_SCAN_BINARY (0)
+#define PROCDB_SCAN_CSV (1)
+
+/**
+ * @brief status of a result - ok, the process does not exist, the process already exists (insert), the server is read-only, the query was invalid, the epoch of the query is not pinned
+ */
+#define PROCDB_OK (0)
+#define PROCDB_NOT_FOUND (1)
+#define PROCDB_EXISTS (2)
+#define PROCDB_READ_ONLY (3)
+#define PROCDB_INVALID (4)
+#define PROCDB_NO_EPOCH (5)
+
+/**
+ * @brief procdb is a connection to the server
+ */
+struct procdb;
+
+/**
+ * @brief procdb_query is one query - only the members its type needs get used
+ */
+struct procdb_query {
+    /* PROCDB_QUERY_... */
+    int type;
+    /* process of a field, command, insert, update or delete - for a watch -1 watches all processes */
+    int pid;
+    /* PROCDB_CPU, PROCDB_MEM, PROCDB_TIME or PROCDB_COMMAND (only for command updates) - PROCDB_COMMAND or PROCDB_PID for a distinct query */
+    int field;
+    /* PROCDB_MIN, PROCDB_MAX, PROCDB_SUM or PROCDB_AVG of an aggregate */
+    int aggregate;
+    /* bitmasks of the aggregates and fields of a stats query */
+    int aggregates;
+    int fields;
+    /* cpu, mem and time of an insert - for an update only values[field] gets used */
+    int values[3];
+    /* command line of an insert or command update - it has to stay valid until the result got collected */
+    const char *command;
+    size_t command_length;
+    /* PROCDB_ABOVE or PROCDB_BELOW and the threshold of a watch */
+    int condition;
+    int threshold;
+    /* epoch a field, command, aggregate, stats or distinct query reads - 0 for the current one, otherwise it must be pinned */
+    uint64_t epoch;
+    /* distinct query - count exactly instead of estimating (only for tables of up to 2^18 rows), or count the values that got loaded or written in the last windows minutes instead of the ones in the table */
+    int exact;
+    int windows;
+};
+
+/**
+ * @brief procdb_result is the result of a query
+ */
+struct procdb_result {
+    /* PROCDB_OK, PROCDB_NOT_FOUND, ... */
+    int status;
+    /* value of a field or aggregate, index of a watch, number of distinct values - an estimate has a standard error of 0.81% */
+    int value;
+    /* results of a stats query - indexed by field and aggregate */
+    long long stats[3][4];
+    /* command line of a command query - points into the string heap of the server and is not null terminated */
+    const char *command;
+    size_t command_length;
+};
+
+/**
+ * @brief procdb_row is a row of a binary scan page
+ */
+struct procdb_row {
+    int pid;
+    int cpu;
+    int mem;
+    int time;
+    /* command line in the string heap - see procdb_string */
+    size_t command_offset;
+    size_t command_length;
+};
+
+/**
+ * @brief procdb_scan is a running scan - initialize it with procdb_scan_begin
+ */
+struct procdb_scan {
+    /* cursor of the server - -1 as long as none is open */
+    int cursor;
+    /* PROCDB_SCAN_BINARY or PROCDB_SCAN_CSV */
+    int format;
+    /* epoch the scan reads - 0 for the current one, otherwise it must be pinned. it can be set after procdb_scan_begin */
+    uint64_t epoch;
+    /* current page - struct procdb_row for binary scans, text for csv scans. it stays valid until the next call of procdb_scan_next */
+    const void *page;
+    size_t rows;
+    size_t bytes;
+};
+
+/**
+ * @brief procdb_event is a process that started to fulfil the condition of a watch
+ */
+struct procdb_event {
+    int pid;
+    int field;
+    int value;
+    /* time from applying the write on the server to reading the event */
+    long long latency_ns;
+};
+
+/**
+ * @brief connects to the server
+ * @param flags 0 or PROCDB_BUSY_POLL
+ * @return the connection or NULL on error (errno is set - EAGAIN if the server is still loading its data)
+ */
+struct procdb *procdb_connect(int flags);
+
+/**
+ * @brief closes a connection - results that were not collected get lost
+ * @param db connection to close
+ */
+void procdb_disconnect(struct procdb *db);
+
+/**
+ * @brief submits a query - it gets handed to the server as soon as a request slot is free
+ * @param db connection to submit to
+ * @param query query to submit - gets copied
+ * @return ticket to collect the result with or -1 on error (errno is EAGAIN if PROCDB_QUEUE_SIZE requests are not collected yet)
+ */
+int procdb_submit(struct procdb *db, const struct procdb_query *query);
+
+/**
+ * @brief collects the result of a query if it is ready - does not block
+ * @param db connection the query was submitted to
+ * @param ticket ticket of the query
+ * @param result gets filled with the result
+ * @return 1 if the result was collected, 0 if it is not ready yet or -1 on error (errno is set)
+ */
+int procdb_poll(struct procdb *db, int ticket, struct procdb_result *result);
+
+/**
+ * @brief waits for the result of a query and collects it
+ * @param db connection the query was submitted to
+ * @param ticket ticket of the query
+ * @param result gets filled with the result
+ * @return 0 on success or -1 on error (errno is set - ETIMEDOUT if the server reclaimed the request, EPIPE if the server is down)
+ */
+int procdb_wait(struct procdb *db, int ticket, struct procdb_result *result);
+
+/**
+ * @brief waits until the result of any submitted query is ready and collects it
+ * @param db connection the queries were submitted to
+ * @param result gets filled with the result
+ * @return ticket of the collected query or -1 on error (errno is set - EINVAL if nothing was submitted)
+ */
+int procdb_wait_any(struct procdb *db, struct procdb_result *result);
+
+/**
+ * @brief submits a query and waits for its result
+ * @param db connection to use
+ * @param query query to execute
+ * @param result gets filled with the result
+ * @return 0 on success or -1 on error (errno is set)
+ */
+int procdb_execute(struct procdb *db, const struct procdb_query *query, struct procdb_result *result);
+
+/**
+ * @brief returns a string of the string heap of the server - once an update or delete replaced it the server may reuse it HEAP_GRACE_MS after the last reader of an older epoch, so keep a copy for longer
+ * @param db connection to use
+ * @param offset offset of the string
+ * @param length length of the string
+ * @return pointer to the string (not null terminated) or NULL on error (errno is set)
+ */
+const char *procdb_string(struct procdb *db, size_t offset, size_t length);
+
+/**
+ * @brief initializes a scan of the whole table
+ * @param scan scan to initialize
+ * @param format PROCDB_SCAN_BINARY or PROCDB_SCAN_CSV
+ */
+void procdb_scan_begin(struct procdb_scan *scan, int format);
+
+/**
+ * @brief fetches the next page of a scan - the scan reads the epoch it asked for or the one that was current at the first call
+ * @param db connection to use
+ * @param scan scan to continue
+ * @return 1 if the page has rows, 0 at the end of the scan or -1 on error (errno is set - EBUSY if no cursor is free, ESTALE if the epoch is not pinned)
+ */
+int procdb_scan_next(struct procdb *db, struct procdb_scan *scan);
+
+/**
+ * @brief returns the current epoch of the server - the number of writes since it started plus one
+ * @param db connection to use
+ * @return the current epoch
+ */
+uint64_t procdb_epoch(struct procdb *db);
+
+/**
+ * @brief pins an epoch - the server keeps it readable until procdb_end or until the process ends
+ * @param db connection to use
+ * @param epoch epoch to pin - 0 for the current one, otherwise an epoch that is pinned already
+ * @param pinned gets set to the pinned epoch
+ * @return the pin or -1 on error (errno is set - EBUSY if no pin is free, ESTALE if the epoch is not pinned)
+ */
+int procdb_begin(struct procdb *db, uint64_t epoch, uint64_t *pinned);
+
+/**
+ * @brief releases a pin
+ * @param db connection the pin was taken with
+ * @param pin pin to release
+ */
+void procdb_end(struct procdb *db, int pin);
+
+/**
+ * @brief starts a watch
+ * @param db connection to use
+ * @param pid watched process or -1 for all processes
+ * @param field PROCDB_CPU, PROCDB_MEM or PROCDB_TIME
+ * @param condition PROCDB_ABOVE or PROCDB_BELOW
+ * @param threshold threshold of the condition
+ * @return the watch or -1 on error (errno is set - EBUSY if no watch is free)
+ */
+int procdb_watch(struct procdb *db, int pid, int field, int condition, int threshold);
+
+/**
+ * @brief waits for the next event of a watch
+ * @param db connection the watch was started with
+ * @param watch watch to wait for
+ * @param event gets filled with the event
+ * @param timeout_ms longest time to wait
+ * @return 1 if an event was read, 0 on timeout or -1 on error (errno is set - EINTR if a signal was caught)
+ */
+int procdb_watch_next(struct procdb *db, int watch, struct procdb_event *event, int timeout_ms);
+
+/**
+ * @brief returns the number of events of a watch the server had to drop because they were not read in time
+ * @param db connection the watch was started with
+ * @param watch watch to check
+ * @return number of dropped events
+ */
+uint64_t procdb_watch_dropped(struct procdb *db, int watch);
+
+/**
+ * @brief stops a watch
+ * @param db connection the watch was started with
+ * @param watch watch to stop
+ */
+void procdb_unwatch(struct procdb *db, int watch);
+
+#endif
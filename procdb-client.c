@@ -5,13 +5,14 @@
  * 
  * @brief the client is a part of procdb - it is the interface for the user to access the process-database
  *
- * @details the client communicate with the server via shared memory. cpu, mem, time or command can be asked of the server for every process.
+ * @details the client communicate with the server via libprocdb. cpu, mem, time or command can be asked of the server for every process.
  *
  * @date 21.05.2017
  * 
  */
 
 #include "procdb.h"
+#include "libprocdb.h"
 
 
 /**
@@ -19,6 +20,21 @@
  */
 #define LINE_SIZE (1024)
 
+/**
+ * @brief names of the fields that can be aggregated - the index is the bit in the bitmask of a stats request
+ */
+static const char *field_names[STATS_FIELDS] = {"cpu", "mem", "time"};
+
+/**
+ * @brief names of the aggregates - the index is the bit in the bitmask of a stats request
+ */
+static const char *aggregate_names[STATS_AGGREGATES] = {"min", "max", "sum", "avg"};
+
+/**
+ * @brief names of the fields that can be updated - the index is the field of an update request
+ */
+static const char *update_names[STATS_FIELDS+1] = {"cpu", "mem", "time", "command"};
+
 
  /**
  * @brief Name of the program
@@ -31,29 +47,34 @@ static const char *progname = "procdb-client"; /* default name */
 volatile sig_atomic_t quit = 0;
 
 /**
- * @brief semaphore for client
+ * @brief number of times every request gets sent in benchmark mode (option -b) - 0 if not in benchmark mode
  */
-sem_t *client;
+long bench_iterations = 0;
 
 /**
- * @brief semaphore for server
+ * @brief number of requests the benchmark keeps in flight (option -q) - 0 if every request gets executed on its own
  */
-sem_t *server;
+int queue_depth = 0;
 
 /**
- * @brief semaphore for interaction_started
+ * @brief flags of the connection - PROCDB_BUSY_POLL if the client busy polls for its responses (option -p) instead of sleeping on the semaphore of its slot
  */
-sem_t *interaction_started;
+int connect_flags = 0;
 
 /**
- * @brief variable indicating if semaphores & shared memory are set up 
+ * @brief connection to the server - NULL as long as the client is not connected
  */
-int client_set_up = 0;
+struct procdb *db = NULL;
 
 /**
- * @brief shm is the structure for the shared memory - it needs to be locked before use with a semaphore
+ * @brief pin of the epoch the reads go to (commands begin and as of) - -1 if the reads go to the current epoch
  */
- struct shm_struct *shm;
+int pin = -1;
+
+/**
+ * @brief epoch the reads go to - 0 for the current one
+ */
+uint64_t pinned_epoch = 0;
 
 
  /**
@@ -82,22 +103,123 @@ static void parse_args(int argc, char **argv);
  */
 static void signal_handler(int sig);
 
+/**
+ * @brief pins an epoch for the following reads - a pin the client already has gets released if the new one could be taken
+ * @param epoch epoch to pin - 0 for the current one
+ */
+static void begin_epoch(uint64_t epoch);
+
+/**
+ * @brief releases the pin of the client - the following reads go to the current epoch again
+ */
+static void end_epoch(void);
+
 /**
  * @brief prints an information what an valid command should look like
  */
 static void print_invalid_command(void);
 
 /**
- * @brief executes sem_wait for a specific semaphore
- * @param sem semaphore to execute for
+ * @brief parses the rest of a stats request - "stats [AGGREGATES] FIELDS" where both are comma separated lists
+ * @param query gets the bitmasks of the aggregates (all of them if none were given) and of the fields
+ * @return TRUE if the request was valid - otherwise FALSE
+ */
+static int parse_stats(struct procdb_query *query);
+
+/**
+ * @brief parses the rest of a distinct request - "distinct command|pid [exact | last MINUTES]"
+ * @param query gets filled with the distinct count
+ * @return TRUE if the request was valid - otherwise FALSE
+ */
+static int parse_distinct(struct procdb_query *query);
+
+/**
+ * @brief parses a comma separated list of names into a bitmask
+ * @param list list to parse - gets modified
+ * @param names names that are allowed - the index is the bit
+ * @param count number of names
+ * @return the bitmask or -1 if a name is not allowed
+ */
+static int parse_name_list(char *list, const char **names, int count);
+
+/**
+ * @brief parses an int >= 0
+ * @param s string to parse - may be NULL
+ * @param value gets set to the parsed int
+ * @return TRUE if s was a valid int >= 0 - otherwise FALSE
+ */
+static int parse_int(const char *s, int *value);
+
+/**
+ * @brief parses the rest of a write request - "insert PID CPU MEM TIME COMMAND", "update PID FIELD VALUE" or "delete PID"
+ * @param type PROCDB_QUERY_INSERT, PROCDB_QUERY_UPDATE or PROCDB_QUERY_DELETE
+ * @param query gets filled with the write
+ * @return TRUE if the request was valid - otherwise FALSE
+ */
+static int parse_write(int type, struct procdb_query *query);
+
+/**
+ * @brief parses the rest of a watch request - "watch PID|all FIELD >|< THRESHOLD"
+ * @param query gets filled with the watch
+ * @return TRUE if the request was valid - otherwise FALSE
+ */
+static int parse_watch(struct procdb_query *query);
+
+/**
+ * @brief prints the events of a watch until a signal gets received, gives the watch back and prints the notification latency
+ * @param query the request as the user entered it
+ * @param watch the watch
+ */
+static void run_watch(const char *query, int watch);
+
+/**
+ * @brief scans the whole table page by page and prints every row - in benchmark mode the scan gets repeated bench_iterations times and the throughput gets printed instead
+ * @param query the request as the user entered it
+ * @param format PROCDB_SCAN_BINARY or PROCDB_SCAN_CSV
+ */
+static void run_scan(const char *query, int format);
+
+/**
+ * @brief shuts the client down if a request failed for any other reason than the server reclaiming its slot
+ * @param what what failed
  */
-void wait_sem(sem_t *sem);
+static void check_failure(const char *what);
 
 /**
- * @brief executes sem_post for a specific semaphore
- * @param sem semaphore to execute for
+ * @brief executes one request
+ * @param query the request
+ * @param print TRUE if the result should be printed
+ * @return value of the result - -1 if the slot got reclaimed before the result was read
  */
-void post_sem(sem_t *sem);
+static int run_request(const struct procdb_query *query, int print);
+
+/**
+ * @brief prints the result of a request
+ * @param query the request
+ * @param result its result
+ */
+static void print_result(const struct procdb_query *query, const struct procdb_result *result);
+
+/**
+ * @brief sends one request bench_iterations times and prints throughput and latency percentiles - with queue_depth requests in flight if it is set
+ * @param name the request as the user entered it
+ * @param query the request
+ */
+static void run_benchmark(const char *name, const struct procdb_query *query);
+
+/**
+ * @brief compares two latencies - used for qsort
+ * @param a first latency
+ * @param b second latency
+ * @return <0, 0 or >0
+ */
+static int compare_latency(const void *a, const void *b);
+
+/**
+ * @brief returns the current CLOCK_MONOTONIC time
+ * @return time in ns
+ */
+static long long monotonic_ns(void);
 
 
 static void bail_out(int exitcode, const char *fmt, ...) {
@@ -120,56 +242,497 @@ static void bail_out(int exitcode, const char *fmt, ...) {
 
 static void free_resources(void) {
     printf("freeing resources\n");
-    if (client_set_up) {
-        /* unmap shared memory */
-        if (munmap(shm, sizeof *shm) == -1) {
-            printf("could not munmap shared memory");
+    if (db != NULL) {
+        end_epoch();
+        procdb_disconnect(db);
+        db = NULL;
+    }
+}
+
+static void parse_args(int argc, char **argv) {
+    if(argc > 0) {
+        progname = argv[0];
+    }
+    int c;
+    char *endptr;
+    while ((c = getopt(argc, argv, "b:pq:")) != -1) {
+        switch (c) {
+        case 'p':
+            connect_flags |= PROCDB_BUSY_POLL;
+            break;
+        case 'b':
+            endptr = NULL;
+            bench_iterations = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0' || bench_iterations <= 0) {
+                bail_out(EXIT_FAILURE, "invalid number of iterations - usage: procdb-client [-p] [-b iterations [-q depth]]");
+            }
+            break;
+        case 'q':
+            if (!parse_int(optarg, &queue_depth) || queue_depth < 1 || queue_depth > PROCDB_QUEUE_SIZE) {
+                bail_out(EXIT_FAILURE, "invalid queue depth (1-%d) - usage: procdb-client [-p] [-b iterations [-q depth]]", PROCDB_QUEUE_SIZE);
+            }
+            break;
+        default:
+            bail_out(EXIT_FAILURE, "invalid option - usage: procdb-client [-p] [-b iterations [-q depth]]");
+        }
+    }
+    if (optind != argc) {
+        bail_out(EXIT_FAILURE, "no arguments - usage: procdb-client [-p] [-b iterations [-q depth]]");
+    }
+}
+
+static void signal_handler(int sig) {
+    quit = 1;
+}
+
+static void print_invalid_command(void) {
+    printf("INVALID COMMAND: command must look like PID INFO - PID = {min, max, sum, avg, i} where i is a valid int >= 0, INFO = {cpu, mem, time, command}\ncommand can only appear with a specific pid\n"
+        "or like stats [AGGREGATES] FIELDS - AGGREGATES = comma separated list of {min, max, sum, avg} (all if left out), FIELDS = comma separated list of {cpu, mem, time}\n"
+        "or like scan [csv] - prints every process, the server formats the rows if csv is given\n"
+        "or like watch PID FIELD CONDITION THRESHOLD - PID = {all, i}, FIELD = {cpu, mem, time}, CONDITION = {>, <} - prints every process that starts to fulfil the condition until the client gets stopped\n"
+        "or like insert PID CPU MEM TIME COMMAND, update PID {cpu, mem, time} VALUE, update PID command COMMAND or delete PID - COMMAND is the rest of the line and must not contain ','\n"
+        "or like distinct FIELD [exact | last MINUTES] - FIELD = {command, pid}, estimates the number of distinct values in the table (0.81%% standard error), counts them exactly or estimates the ones loaded or written in the last MINUTES <= 60 minutes\n"
+        "or like epoch - prints the current epoch, begin or as of EPOCH - the following reads and scans see the table as it was at the current epoch or at EPOCH (EPOCH must be pinned by another client), end - the reads go to the current epoch again\n");
+}
+
+static void begin_epoch(uint64_t epoch) {
+    uint64_t pinned;
+    int taken = procdb_begin(db, epoch, &pinned);
+    if (taken == -1) {
+        if (errno == ESTALE) {
+            errno = 0;
+            printf("epoch %llu is not available\n", (unsigned long long) epoch);
+        } else if (errno == EBUSY) {
+            errno = 0;
+            printf("no pin left - try again later\n");
+        } else {
+            check_failure("pinning the epoch failed");
+            printf("request timed out - the server reclaimed the slot\n");
         }
+        return;
     }
-    if (server != 0) {
-        if (sem_close(server) == -1) {
-            printf("could not close server semaphore");
+    end_epoch();
+    pin = taken;
+    pinned_epoch = pinned;
+    printf("epoch %llu\n", (unsigned long long) pinned_epoch);
+}
+
+static void end_epoch(void) {
+    if (pin != -1) {
+        procdb_end(db, pin);
+        pin = -1;
+        pinned_epoch = 0;
+    }
+}
+
+static int parse_name_list(char *list, const char **names, int count) {
+    int mask = 0;
+    char *saveptr = NULL;
+    for (char *name = strtok_r(list, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+        int bit = -1;
+        for (int i = 0; i < count; ++i) {
+            if (strcmp(names[i], name) == 0) {
+                bit = i;
+            }
+        }
+        if (bit == -1) {
+            return -1;
         }
+        mask |= 1 << bit;
+    }
+    return mask;
+}
+
+static int parse_int(const char *s, int *value) {
+    if (s == NULL) {
+        return FALSE;
+    }
+    char *endptr = NULL;
+    errno = 0;
+    long l = strtol(s, &endptr, 10);
+    if (endptr == s || *endptr != '\0' || errno == ERANGE || l < 0 || l > INT_MAX) {
+        errno = 0;
+        return FALSE;
+    }
+    *value = (int) l;
+    return TRUE;
+}
+
+static int parse_write(int type, struct procdb_query *query) {
+    memset(query, 0, sizeof *query);
+    query->type = type;
+    query->field = -1;
+    if (!parse_int(strtok(NULL, " \n"), &query->pid)) {
+        return FALSE;
     }
-    if (client != 0) {
-        if (sem_close(client) == -1) {
-            printf("could not close client semaphore");
+    int command_follows = FALSE;
+    if (type == PROCDB_QUERY_INSERT) {
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            if (!parse_int(strtok(NULL, " \n"), &query->values[f])) {
+                return FALSE;
+            }
+        }
+        command_follows = TRUE;
+    } else if (type == PROCDB_QUERY_UPDATE) {
+        char *name = strtok(NULL, " \n");
+        for (int f = 0; name != NULL && f <= STATS_FIELDS; ++f) {
+            if (strcmp(update_names[f], name) == 0) {
+                query->field = f;
+            }
+        }
+        if (query->field == -1) {
+            return FALSE;
+        }
+        if (query->field == PROCDB_COMMAND) {
+            command_follows = TRUE;
+        } else if (!parse_int(strtok(NULL, " \n"), &query->values[query->field])) {
+            return FALSE;
         }
     }
-    if (interaction_started != 0) {
-        if (sem_close(interaction_started) == -1) {
-            printf("could not close interaction_started semaphore");
+    if (command_follows) {
+        /* the command line is the rest of the line and may contain spaces */
+        char *command = strtok(NULL, "\n");
+        if (command == NULL) {
+            return FALSE;
         }
+        command += strspn(command, " ");
+        query->command = command;
+        query->command_length = strlen(command);
+        return query->command_length > 0 && query->command_length <= REQUEST_DATA_SIZE && strchr(command, ',') == NULL;
     }
+    return strtok(NULL, " \n") == NULL;
 }
 
-static void parse_args(int argc, char **argv) {
-    if(argc > 0) {
-        progname = argv[0];
+static int parse_watch(struct procdb_query *query) {
+    char *pid = strtok(NULL, " \n");
+    char *name = strtok(NULL, " \n");
+    char *condition = strtok(NULL, " \n");
+    char *threshold = strtok(NULL, " \n");
+    if (pid == NULL || name == NULL || condition == NULL || strtok(NULL, " \n") != NULL) {
+        return FALSE;
     }
-    if (argc != 1) {
-        bail_out(EXIT_FAILURE, "no arguments - usage: procdb-client");
+    memset(query, 0, sizeof *query);
+    query->type = PROCDB_QUERY_WATCH;
+    if (strcmp("all", pid) == 0) {
+        query->pid = -1;
+    } else if (!parse_int(pid, &query->pid)) {
+        return FALSE;
     }
+    query->field = -1;
+    for (int f = 0; f < STATS_FIELDS; ++f) {
+        if (strcmp(field_names[f], name) == 0) {
+            query->field = f;
+        }
+    }
+    if (strcmp(">", condition) == 0) {
+        query->condition = PROCDB_ABOVE;
+    } else if (strcmp("<", condition) == 0) {
+        query->condition = PROCDB_BELOW;
+    } else {
+        return FALSE;
+    }
+    return query->field != -1 && parse_int(threshold, &query->threshold);
 }
 
-static void signal_handler(int sig) {
-    quit = 1;
+static int parse_stats(struct procdb_query *query) {
+    char *first = strtok(NULL, " \n");
+    char *second = strtok(NULL, " \n");
+    if (first == NULL || strtok(NULL, " \n") != NULL) {
+        return FALSE;
+    }
+    memset(query, 0, sizeof *query);
+    query->type = PROCDB_QUERY_STATS;
+    if (second == NULL) {
+        query->aggregates = (1 << STATS_AGGREGATES) - 1;
+        query->fields = parse_name_list(first, field_names, STATS_FIELDS);
+    } else {
+        query->aggregates = parse_name_list(first, aggregate_names, STATS_AGGREGATES);
+        query->fields = parse_name_list(second, field_names, STATS_FIELDS);
+    }
+    return query->aggregates > 0 && query->fields > 0;
 }
 
-static void print_invalid_command(void) {
-    printf("INVALID COMMAND: command must look like PID INFO - PID = {min, max, sum, avg, i} where i is a valid int >= 0, INFO = {cpu, mem, time, command}\ncommand can only appear with a specific pid\n");
+static int parse_distinct(struct procdb_query *query) {
+    char *field = strtok(NULL, " \n");
+    char *mode = strtok(NULL, " \n");
+    char *minutes = mode != NULL && strcmp("last", mode) == 0 ? strtok(NULL, " \n") : NULL;
+    if (field == NULL || strtok(NULL, " \n") != NULL) {
+        return FALSE;
+    }
+    memset(query, 0, sizeof *query);
+    query->type = PROCDB_QUERY_DISTINCT;
+    if (strcmp("command", field) == 0) {
+        query->field = PROCDB_COMMAND;
+    } else if (strcmp("pid", field) == 0) {
+        query->field = PROCDB_PID;
+    } else {
+        return FALSE;
+    }
+    if (mode == NULL) {
+        return TRUE;
+    }
+    if (strcmp("exact", mode) == 0) {
+        query->exact = TRUE;
+        return TRUE;
+    }
+    return minutes != NULL && parse_int(minutes, &query->windows) && query->windows >= 1 && query->windows <= PROCDB_DISTINCT_WINDOWS;
+}
+
+static long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void check_failure(const char *what) {
+    if (errno == EPIPE) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "server seems to be down");
+    }
+    if (errno != ETIMEDOUT) {
+        bail_out(EXIT_FAILURE, "%s", what);
+    }
+    errno = 0;
+}
+
+static int run_request(const struct procdb_query *query, int print) {
+    struct procdb_result result;
+    if (procdb_execute(db, query, &result) == -1) {
+        check_failure("request failed");
+        printf("request timed out - the server reclaimed the slot\n");
+        return -1;
+    }
+    if (print) {
+        print_result(query, &result);
+    }
+    return result.value;
+}
+
+static void print_result(const struct procdb_query *query, const struct procdb_result *result) {
+    if (result->status == PROCDB_NO_EPOCH) {
+        printf("epoch %llu is not available\n", (unsigned long long) query->epoch);
+        return;
+    }
+    switch (query->type) {
+    case PROCDB_QUERY_WATCH:
+        if (result->status != PROCDB_OK) {
+            printf("no watch left - try again later\n");
+        }
+        break;
+    case PROCDB_QUERY_INSERT:
+    case PROCDB_QUERY_UPDATE:
+    case PROCDB_QUERY_DELETE:
+        if (result->status == PROCDB_OK) {
+            printf("%d ok\n", query->pid);
+        } else if (result->status == PROCDB_NOT_FOUND) {
+            printf("%d does not exist\n", query->pid);
+        } else if (result->status == PROCDB_EXISTS) {
+            printf("%d already exists\n", query->pid);
+        } else if (result->status == PROCDB_READ_ONLY) {
+            printf("%d not written - the server is read-only\n", query->pid);
+        } else {
+            printf("%d not written - invalid request\n", query->pid);
+        }
+        break;
+    case PROCDB_QUERY_STATS:
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            if (query->fields & (1 << f)) {
+                printf("%s", field_names[f]);
+                for (int a = 0; a < STATS_AGGREGATES; ++a) {
+                    if (query->aggregates & (1 << a)) {
+                        printf(" %s %lld", aggregate_names[a], result->stats[f][a]);
+                    }
+                }
+                printf("\n");
+            }
+        }
+        break;
+    case PROCDB_QUERY_AGGREGATE:
+        printf("- %d\n", result->value);
+        break;
+    case PROCDB_QUERY_DISTINCT:
+        if (result->status != PROCDB_OK) {
+            printf("no exact count - the table has more than %d rows\n", DISTINCT_EXACT_ROWS);
+        } else {
+            /* estimates are marked as such */
+            printf("%s %d\n", query->exact ? "-" : "~", result->value);
+        }
+        break;
+    case PROCDB_QUERY_COMMAND:
+        if (result->status == PROCDB_NOT_FOUND) {
+            printf("%d no command\n", query->pid);
+        } else {
+            /* the command line gets read in place - no copy of it is made */
+            printf("%d ", query->pid);
+            (void) fwrite(result->command, 1, result->command_length, stdout);
+            printf("\n");
+        }
+        break;
+    default:
+        printf("%d %d\n", query->pid, result->value);
+        break;
+    }
+}
+
+static void run_scan(const char *query, int format) {
+    long iterations = bench_iterations > 0 ? bench_iterations : 1;
+    unsigned long long rows = 0, bytes = 0, pages = 0, checksum = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long n = 0; n < iterations && quit == 0; ++n) {
+        struct procdb_scan scan;
+        procdb_scan_begin(&scan, format);
+        scan.epoch = pinned_epoch;
+        int more;
+        do {
+            more = procdb_scan_next(db, &scan);
+            if (more == -1) {
+                if (errno == ESTALE) {
+                    errno = 0;
+                    printf("epoch %llu is not available\n", (unsigned long long) pinned_epoch);
+                    return;
+                }
+                if (errno != EBUSY) {
+                    check_failure("scan failed");
+                }
+                printf("scan failed - no cursor left or the cursor got reclaimed\n");
+                return;
+            }
+            /* the page stays as it is until the next page of this scan gets fetched */
+            const char *page = scan.page;
+            const struct procdb_row *p = scan.page;
+            if (bench_iterations > 0) {
+                /* touch every row so the benchmark measures the transfer and not only the handshakes */
+                if (format == PROCDB_SCAN_BINARY) {
+                    for (size_t i = 0; i < scan.rows; ++i) {
+                        checksum += p[i].pid;
+                    }
+                } else {
+                    for (size_t i = 0; i < scan.bytes; ++i) {
+                        checksum += page[i];
+                    }
+                }
+            } else if (format == PROCDB_SCAN_BINARY) {
+                for (size_t i = 0; i < scan.rows; ++i) {
+                    const char *command = procdb_string(db, p[i].command_offset, p[i].command_length);
+                    if (command == NULL) {
+                        bail_out(EXIT_FAILURE, "could not read command line from string heap");
+                    }
+                    printf("%d,%d,%d,%d,", p[i].pid, p[i].cpu, p[i].mem, p[i].time);
+                    (void) fwrite(command, 1, p[i].command_length, stdout);
+                    printf("\n");
+                }
+            } else {
+                (void) fwrite(page, 1, scan.bytes, stdout);
+            }
+            rows += scan.rows;
+            bytes += scan.bytes;
+            ++pages;
+        } while (more == 1 && quit == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (bench_iterations > 0) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%s: %llu rows in %llu pages, %.0f rows/s, %.0f MB/s (checksum %llu)\n", query, rows, pages, rows / seconds, bytes / seconds / 1e6, checksum);
+    }
 }
 
-void wait_sem(sem_t *sem) {
-    if (sem_wait(sem) == -1) {
-        bail_out(errno, "sem_wait failed");
+static void run_watch(const char *query, int watch) {
+    size_t capacity = 1024;
+    size_t count = 0;
+    long long *latencies = malloc(capacity * sizeof *latencies);
+    if (latencies == NULL) {
+        bail_out(EXIT_FAILURE, "could not allocate latencies for watch");
+    }
+    while (quit == 0) {
+        struct procdb_event event;
+        int got = procdb_watch_next(db, watch, &event, WAIT_INTERVAL_MS);
+        if (got == -1) {
+            if (errno == EINTR) {
+                errno = 0;
+                continue;
+            }
+            check_failure("waiting for watch events failed");
+        }
+        if (got != 1) {
+            continue;
+        }
+        printf("%d %s %d\n", event.pid, field_names[event.field], event.value);
+        if (count == capacity) {
+            long long *grown = realloc(latencies, 2 * capacity * sizeof *latencies);
+            if (grown == NULL) {
+                bail_out(EXIT_FAILURE, "could not grow latencies for watch");
+            }
+            latencies = grown;
+            capacity *= 2;
+        }
+        latencies[count++] = event.latency_ns;
+    }
+    uint64_t dropped = procdb_watch_dropped(db, watch);
+    procdb_unwatch(db, watch);
+    if (count > 0) {
+        qsort(latencies, count, sizeof *latencies, compare_latency);
+        printf("%s: %lu events, %llu dropped, notification latency p50 %.2f us, p99 %.2f us, max %.2f us\n", query, (unsigned long) count,
+            (unsigned long long) dropped, latencies[count / 2] / 1e3, latencies[(count * 99) / 100] / 1e3, latencies[count - 1] / 1e3);
     }
+    free(latencies);
 }
 
-void post_sem(sem_t *sem) {
-    if (sem_post(sem) == -1) {
-        bail_out(errno, "sem_post failed");
+static int compare_latency(const void *a, const void *b) {
+    long long la = *(const long long *) a;
+    long long lb = *(const long long *) b;
+    return (la > lb) - (la < lb);
+}
+
+static void run_benchmark(const char *name, const struct procdb_query *query) {
+    long long *latencies = malloc(bench_iterations * sizeof *latencies);
+    if (latencies == NULL) {
+        bail_out(EXIT_FAILURE, "could not allocate latencies for benchmark");
+    }
+    /* time every ticket got submitted at */
+    long long submitted[PROCDB_QUEUE_SIZE];
+    struct procdb_result result;
+    long sent = 0, done = 0;
+    int in_flight = 0;
+    long long start = monotonic_ns();
+    while (done < bench_iterations && quit == 0) {
+        if (queue_depth == 0) {
+            long long request_start = monotonic_ns();
+            run_request(query, FALSE);
+            latencies[done++] = monotonic_ns() - request_start;
+            continue;
+        }
+        /* keep queue_depth requests in flight - the server answers all of them with one pass over the slots */
+        while (in_flight < queue_depth && sent < bench_iterations) {
+            int ticket = procdb_submit(db, query);
+            if (ticket == -1) {
+                check_failure("submit failed");
+                break;
+            }
+            submitted[ticket] = monotonic_ns();
+            ++in_flight;
+            ++sent;
+        }
+        int ticket = procdb_wait_any(db, &result);
+        if (ticket == -1) {
+            check_failure("request failed");
+            printf("request timed out - the server reclaimed the slot\n");
+            /* the reclaimed request can not be collected anymore */
+            --in_flight;
+            ++done;
+            continue;
+        }
+        --in_flight;
+        latencies[done++] = monotonic_ns() - submitted[ticket];
+    }
+    long long end = monotonic_ns();
+    if (done > 0) {
+        double seconds = (end - start) / 1e9;
+        qsort(latencies, done, sizeof *latencies, compare_latency);
+        printf("%s: %ld requests, %.0f requests/s, p50 %.2f us, p99 %.2f us, max %.2f us\n", name, done, done / seconds,
+            latencies[done / 2] / 1e3, latencies[(done * 99) / 100] / 1e3, latencies[done - 1] / 1e3);
     }
+    free(latencies);
 }
 
 /**
@@ -198,59 +761,139 @@ int main(int argc, char *argv[]) {
     /* parse arguments */
     parse_args(argc, argv);
 
-    /* check if shared memory object exists */
-    int shmfd = shm_open(SHM_SERVER, O_RDWR, PERMISSION);
-    if (shmfd == -1) {
-        bail_out(errno, "server seems to be down");
-    }
-    /* set up shared memory for the client to use */
-    if (ftruncate(shmfd, sizeof *shm) == -1) {
-        bail_out(errno, "could not ftruncate");
-    }
-    shm = mmap(NULL, sizeof *shm, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
-    if (shm == MAP_FAILED) {
-        bail_out(errno, "could not correctly execute mmap");
-    }
-    if (close(shmfd) == -1) {
-        bail_out(errno, "could not close shm file descriptor");
-    }
-    /* open semaphores */
-    client = sem_open(SEM_CLIENT, 0);
-    if (client == SEM_FAILED) {
-        bail_out(errno, "could not open client sempahore");
-    }
-    server = sem_open(SEM_SERVER, 0);
-    if (server == SEM_FAILED) {
-        bail_out(errno, "could not opne server sempahore");
-    }
-    interaction_started = sem_open(SEM_INTERACTION_STARTED, 0);
-    if (interaction_started == SEM_FAILED) {
-        bail_out(errno, "could not open interaction_started sempahore");
+    /* connect to the server - it only accepts connections once it published its pid */
+    while ((db = procdb_connect(connect_flags)) == NULL) {
+        if (errno != EAGAIN) {
+            bail_out(errno, "server seems to be down");
+        }
+        if (quit == 1) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "caught signal while waiting for the server");
+        }
+        struct timespec pause = {0, 10000000};
+        (void) nanosleep(&pause, NULL);
     }
 
-    client_set_up = 1;
-
     /* via stdin get commands from user to send to server */
     /* as soon as client received command it gets sent to the server, proccessed there and the client reads the reply and prints it */
-    char* line = malloc((size_t) LINE_SIZE);
-    while(fgets(line, LINE_SIZE-1 , stdin) != NULL) {
+    /* lines can be longer than LINE_SIZE because of the command line of a write */
+    char *line = NULL;
+    size_t line_length = 0;
+    char name[LINE_SIZE];
+    while(getline(&line, &line_length, stdin) != -1) {
         if (quit == 1) {
             printf("caught signal - shutting down\n");
             break;
         }
+        /* keep the request as it was entered for the benchmark output */
+        (void) strncpy(name, line, LINE_SIZE-1);
+        name[LINE_SIZE-1] = '\0';
+        name[strcspn(name, "\n")] = '\0';
         /* check if the command that got entered was valid */
-        char *s = strtok(line," ");
+        char *s = strtok(line," \n");
+        struct procdb_query query;
+        memset(&query, 0, sizeof query);
+        if (s != NULL && strcmp("epoch", s) == 0 && strtok(NULL, " \n") == NULL) {
+            printf("epoch %llu\n", (unsigned long long) procdb_epoch(db));
+            continue;
+        }
+        if (s != NULL && strcmp("begin", s) == 0 && strtok(NULL, " \n") == NULL) {
+            begin_epoch(0);
+            continue;
+        }
+        if (s != NULL && strcmp("end", s) == 0 && strtok(NULL, " \n") == NULL) {
+            end_epoch();
+            continue;
+        }
+        if (s != NULL && strcmp("as", s) == 0) {
+            char *of = strtok(NULL, " \n");
+            char *epoch = strtok(NULL, " \n");
+            char *endptr = NULL;
+            errno = 0;
+            unsigned long long e = epoch == NULL ? 0 : strtoull(epoch, &endptr, 10);
+            if (of == NULL || strcmp("of", of) != 0 || epoch == NULL || endptr == epoch || *endptr != '\0' || errno == ERANGE || e == 0 || strtok(NULL, " \n") != NULL) {
+                errno = 0;
+                print_invalid_command();
+                continue;
+            }
+            begin_epoch(e);
+            continue;
+        }
         /* s should either be an int or min, max, sum, avg */
-        int pid = -1;
-        int pid_cmd = -1;
-        if (strcmp("min", s) == 0) {
-            pid_cmd = 0;
+        int write_type = 0;
+        if (s != NULL && strcmp("insert", s) == 0) {
+            write_type = PROCDB_QUERY_INSERT;
+        } else if (s != NULL && strcmp("update", s) == 0) {
+            write_type = PROCDB_QUERY_UPDATE;
+        } else if (s != NULL && strcmp("delete", s) == 0) {
+            write_type = PROCDB_QUERY_DELETE;
+        }
+        if (write_type != 0) {
+            if (!parse_write(write_type, &query)) {
+                print_invalid_command();
+                continue;
+            }
+            if (bench_iterations > 0) {
+                run_benchmark(name, &query);
+            } else {
+                run_request(&query, TRUE);
+            }
+            continue;
+        }
+        if (s != NULL && strcmp("watch", s) == 0) {
+            if (!parse_watch(&query)) {
+                print_invalid_command();
+                continue;
+            }
+            int watch = procdb_watch(db, query.pid, query.field, query.condition, query.threshold);
+            if (watch == -1) {
+                if (errno != EBUSY) {
+                    check_failure("watch failed");
+                }
+                printf("no watch left - try again later\n");
+                continue;
+            }
+            run_watch(name, watch);
+            continue;
+        }
+        if (s != NULL && strcmp("scan", s) == 0) {
+            char *format = strtok(NULL, " \n");
+            if (format != NULL && (strcmp("csv", format) != 0 || strtok(NULL, " \n") != NULL)) {
+                print_invalid_command();
+                continue;
+            }
+            run_scan(name, format == NULL ? PROCDB_SCAN_BINARY : PROCDB_SCAN_CSV);
+            continue;
+        }
+        if (s != NULL && (strcmp("stats", s) == 0 || strcmp("distinct", s) == 0)) {
+            if (strcmp("stats", s) == 0 ? !parse_stats(&query) : !parse_distinct(&query)) {
+                print_invalid_command();
+                continue;
+            }
+            /* reads go to the pinned epoch - writes always go to the current one */
+            query.epoch = pinned_epoch;
+            if (bench_iterations > 0) {
+                run_benchmark(name, &query);
+            } else {
+                run_request(&query, TRUE);
+            }
+            continue;
+        }
+        if (s == NULL) {
+            print_invalid_command();
+            continue;
+        } else if (strcmp("min", s) == 0) {
+            query.type = PROCDB_QUERY_AGGREGATE;
+            query.aggregate = PROCDB_MIN;
         } else if (strcmp("max", s) == 0) {
-            pid_cmd = 1;
+            query.type = PROCDB_QUERY_AGGREGATE;
+            query.aggregate = PROCDB_MAX;
         } else if (strcmp("sum", s) == 0) {
-            pid_cmd = 2;
+            query.type = PROCDB_QUERY_AGGREGATE;
+            query.aggregate = PROCDB_SUM;
         } else if (strcmp("avg", s) == 0) {
-            pid_cmd = 3;
+            query.type = PROCDB_QUERY_AGGREGATE;
+            query.aggregate = PROCDB_AVG;
         }
         else {
             char *endptr = NULL;
@@ -259,84 +902,60 @@ int main(int argc, char *argv[]) {
                 print_invalid_command();
                 continue;
             }
-            pid = i;
-            if (pid < 0) {
+            if (i < 0) {
                 print_invalid_command();
                 continue;
             }
+            query.type = PROCDB_QUERY_FIELD;
+            query.pid = i;
         }
-        if (pid_cmd != -1 && pid == -1) {
-            pid = -2;
-        }
-        if (pid == -1 && pid_cmd == -1) {
+        /* s should either be cpu, mem, time or command */
+        s = strtok(NULL," ");
+        if (s == NULL) {
             print_invalid_command();
             continue;
         }
-        /* s should either be cpu, mem, time or command */
-        s = strtok(NULL," ");
         if (s[(strlen(s)-1)] == '\n') {
             char *pos = s+strlen(s)-1;
             *pos = '\0';
         }
-        int info = -1;
+        query.field = -1;
         if (strcmp("cpu", s) == 0) {
-            info = 0;
+            query.field = PROCDB_CPU;
         } else if (strcmp("mem", s) == 0) {
-            info = 1;
+            query.field = PROCDB_MEM;
         } else if (strcmp("time", s) == 0) {
-            info = 2;
+            query.field = PROCDB_TIME;
         } else if (strcmp("command", s) == 0) {
-            info = 3;
+            query.field = PROCDB_COMMAND;
         }
-        if (info == -1) {
+        if (query.field == -1) {
             print_invalid_command();
             continue;
         }
-        if (info == 3 && pid_cmd != -1) {
-            print_invalid_command();
-            continue;
+        if (query.field == PROCDB_COMMAND) {
+            if (query.type == PROCDB_QUERY_AGGREGATE) {
+                print_invalid_command();
+                continue;
+            }
+            query.type = PROCDB_QUERY_COMMAND;
         }
         s = strtok(NULL," ");
         if (s != NULL) {
             print_invalid_command();
             continue;
         }
+        query.epoch = pinned_epoch;
 
-        /* lock the shared memory space for the current client */
-        wait_sem(interaction_started);
-
-        /* write the request to the server */
-        wait_sem(client);
-        /* critical section start */
-        shm->pid = pid;
-        shm->pid_cmd = pid_cmd;
-        shm->info = info;
-        /* critical section end */
-        post_sem(server);
-
-        /* read the servers response */
-        wait_sem(client);
-        /* critical section start */
-        if (shm->pid_cmd != -1) {
-            printf("- %d\n", shm->value_d);
-        } else if (shm->info == 3) {
-            if (shm->value[(strlen(shm->value)-1)] == '\n') {
-                char *pos = shm->value+strlen(shm->value)-1;
-                *pos = '\0';
-            }
-            printf("%d %s\n", shm->pid, shm->value);
+        if (bench_iterations > 0) {
+            run_benchmark(name, &query);
         } else {
-            printf("%d %d\n", shm->pid, shm->value_d);
+            run_request(&query, TRUE);
         }
-        /* critical section end */
-        post_sem(server);
-
-        /* unlock the shared memory space */
-        post_sem(interaction_started);
     }
     free(line);
 
     /* EOF file got read - shut down client */
     free_resources();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,557 @@
+/**
+ * @file procdb-column.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief compressed column storage for the process-database of procdb-server
+ *
+ * @details see procdb-column.h for the layout of the blocks
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb-column.h"
+#include "procdb-memory.h"
+
+/**
+ * @brief initial number of slots of the hash table of a dictionary
+ */
+#define DICT_INITIAL_SLOTS (1024)
+
+/**
+ * @brief calculates the FNV-1a hash of a string
+ * @param str string to hash (does not need to be null terminated)
+ * @param length length of str
+ * @return the hash
+ */
+static uint64_t hash_string(const char *str, size_t length);
+
+/**
+ * @brief inserts an id into the hash table of a dictionary - there has to be a free slot
+ * @param dict dictionary to insert into
+ * @param hash hash of the command line
+ * @param id id of the command line
+ */
+static void dict_insert_slot(struct column_dict *dict, uint64_t hash, uint32_t id);
+
+/**
+ * @brief calculates how many bits are needed to store a value
+ * @param value value to store
+ * @return number of bits - 0 if value is 0
+ */
+static unsigned bits_needed(uint64_t value);
+
+/**
+ * @brief writes a value into bit-packed words - the bits it gets written to have to be 0
+ * @param words words to write into
+ * @param pos position of the first bit
+ * @param bits number of bits of the value
+ * @param value value to write
+ */
+static void bits_put(uint64_t *words, uint64_t pos, unsigned bits, uint64_t value);
+
+/**
+ * @brief reads a value out of bit-packed words
+ * @param words words to read from
+ * @param pos position of the first bit
+ * @param bits number of bits of the value
+ * @return the value
+ */
+static uint64_t bits_get(const uint64_t *words, uint64_t pos, unsigned bits);
+
+/**
+ * @brief returns the position of the first bit of a column in a block
+ * @param block block header
+ * @param column 0 - pid, 1 - cpu, 2 - mem, 3 - time, 4 - command
+ * @return position of the first bit
+ */
+static uint64_t block_column_pos(const struct column_block *block, int column);
+
+/**
+ * @brief decodes every value except the pid of one row of a block
+ * @param store store the block belongs to
+ * @param block block header
+ * @param index index of the row in the block
+ * @param row gets filled with the decoded values
+ */
+static void block_decode_row(const struct column_store *store, const struct column_block *block, uint32_t index, struct process *row);
+
+/**
+ * @brief decodes the pids of all rows of a block
+ * @param store store the block belongs to
+ * @param block block header
+ * @param pids gets filled with the pids
+ */
+static void block_decode_pids(const struct column_store *store, const struct column_block *block, int pids[COLUMN_BLOCK_ROWS]);
+
+/**
+ * @brief sort_key is the position a row got loaded at and its pid
+ */
+struct sort_key {
+    int pid;
+    int index;
+};
+
+/**
+ * @brief compares two sort keys by pid and then by position - used for qsort, the position makes the sort stable
+ * @param a first key
+ * @param b second key
+ * @return <0, 0 or >0
+ */
+static int compare_key(const void *a, const void *b);
+
+/**
+ * @brief sorts a list of processes by pid - rows with the same pid keep their order
+ * @param rows list of processes
+ * @param count number of processes
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+static int sort_rows(struct process *rows, int count);
+
+/**
+ * @brief searches the id of a command line by its offset in the string heap
+ * @param dict dictionary to search
+ * @param offset offset of the command line in the string heap
+ * @return id of the command line or -1 if it is not in the dictionary
+ */
+static long dict_find_offset(const struct column_dict *dict, size_t offset);
+
+
+static uint64_t hash_string(const char *str, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void dict_insert_slot(struct column_dict *dict, uint64_t hash, uint32_t id) {
+    uint32_t slot = hash & dict->slot_mask;
+    while (dict->slots[slot] != 0) {
+        slot = (slot + 1) & dict->slot_mask;
+    }
+    dict->slots[slot] = id + 1;
+}
+
+int column_dict_init(struct column_dict *dict) {
+    dict->count = 0;
+    dict->capacity = 0;
+    dict->offset = NULL;
+    dict->length = NULL;
+    dict->slots = calloc(DICT_INITIAL_SLOTS, sizeof *dict->slots);
+    if (dict->slots == NULL) {
+        return -1;
+    }
+    dict->slot_mask = DICT_INITIAL_SLOTS - 1;
+    return 0;
+}
+
+long column_dict_find(const struct column_dict *dict, const char *heap_data, const char *str, size_t length) {
+    uint32_t slot = hash_string(str, length) & dict->slot_mask;
+    while (dict->slots[slot] != 0) {
+        uint32_t id = dict->slots[slot] - 1;
+        if (dict->length[id] == length && memcmp(&heap_data[dict->offset[id]], str, length) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & dict->slot_mask;
+    }
+    return -1;
+}
+
+long column_dict_add(struct column_dict *dict, const char *heap_data, size_t offset, size_t length) {
+    if (dict->count == dict->capacity) {
+        uint32_t capacity = dict->capacity == 0 ? 64 : dict->capacity * 2;
+        size_t *new_offset = realloc(dict->offset, capacity * sizeof *new_offset);
+        if (new_offset == NULL) {
+            return -1;
+        }
+        dict->offset = new_offset;
+        size_t *new_length = realloc(dict->length, capacity * sizeof *new_length);
+        if (new_length == NULL) {
+            return -1;
+        }
+        dict->length = new_length;
+        dict->capacity = capacity;
+    }
+    /* keep the hash table at most half full */
+    if ((dict->count + 1) * 2 > dict->slot_mask + 1) {
+        uint32_t slot_count = (dict->slot_mask + 1) * 2;
+        uint32_t *slots = calloc(slot_count, sizeof *slots);
+        if (slots == NULL) {
+            return -1;
+        }
+        free(dict->slots);
+        dict->slots = slots;
+        dict->slot_mask = slot_count - 1;
+        for (uint32_t id = 0; id < dict->count; ++id) {
+            dict_insert_slot(dict, hash_string(&heap_data[dict->offset[id]], dict->length[id]), id);
+        }
+    }
+    uint32_t id = dict->count++;
+    dict->offset[id] = offset;
+    dict->length[id] = length;
+    dict_insert_slot(dict, hash_string(&heap_data[offset], length), id);
+    return id;
+}
+
+void column_dict_free(struct column_dict *dict) {
+    free(dict->offset);
+    free(dict->length);
+    free(dict->slots);
+    dict->offset = NULL;
+    dict->length = NULL;
+    dict->slots = NULL;
+    dict->count = 0;
+    dict->capacity = 0;
+}
+
+static long dict_find_offset(const struct column_dict *dict, size_t offset) {
+    /* the offsets are ascending because ids get given in the order the strings get appended */
+    long lo = 0;
+    long hi = (long) dict->count - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (dict->offset[mid] == offset) {
+            return mid;
+        } else if (dict->offset[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static unsigned bits_needed(uint64_t value) {
+    unsigned bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+static void bits_put(uint64_t *words, uint64_t pos, unsigned bits, uint64_t value) {
+    if (bits == 0) {
+        return;
+    }
+    size_t word = pos >> 6;
+    unsigned shift = pos & 63;
+    words[word] |= value << shift;
+    if (shift + bits > 64) {
+        words[word + 1] |= value >> (64 - shift);
+    }
+}
+
+static uint64_t bits_get(const uint64_t *words, uint64_t pos, unsigned bits) {
+    if (bits == 0) {
+        return 0;
+    }
+    size_t word = pos >> 6;
+    unsigned shift = pos & 63;
+    uint64_t value = words[word] >> shift;
+    if (shift + bits > 64) {
+        value |= words[word + 1] << (64 - shift);
+    }
+    return value & ((1ULL << bits) - 1);
+}
+
+static uint64_t block_column_pos(const struct column_block *block, int column) {
+    uint64_t pos = block->bit_offset;
+    if (column > 0) {
+        pos += (uint64_t) block->count * block->pid_bits;
+    }
+    for (int f = 0; f < COLUMN_FIELDS && f < column - 1; ++f) {
+        pos += (uint64_t) block->count * block->field_bits[f];
+    }
+    return pos;
+}
+
+static void block_decode_row(const struct column_store *store, const struct column_block *block, uint32_t index, struct process *row) {
+    int values[COLUMN_FIELDS];
+    for (int f = 0; f < COLUMN_FIELDS; ++f) {
+        uint64_t pos = block_column_pos(block, f + 1) + (uint64_t) index * block->field_bits[f];
+        values[f] = (int) ((long long) block->min[f] + (long long) bits_get(store->words, pos, block->field_bits[f]));
+    }
+    row->p_cpu = values[0];
+    row->p_mem = values[1];
+    row->p_time = values[2];
+    uint64_t pos = block_column_pos(block, COLUMN_FIELDS + 1) + (uint64_t) index * block->command_bits;
+    uint32_t id = block->command_min + (uint32_t) bits_get(store->words, pos, block->command_bits);
+    row->p_command_offset = store->dict->offset[id];
+    row->p_command_length = store->dict->length[id];
+}
+
+static void block_decode_pids(const struct column_store *store, const struct column_block *block, int pids[COLUMN_BLOCK_ROWS]) {
+    long long pid = block->pid_min;
+    pids[0] = (int) pid;
+    for (uint32_t j = 1; j < block->count; ++j) {
+        pid += (long long) bits_get(store->words, block->bit_offset + (uint64_t) j * block->pid_bits, block->pid_bits);
+        pids[j] = (int) pid;
+    }
+}
+
+static int compare_key(const void *a, const void *b) {
+    const struct sort_key *ka = a;
+    const struct sort_key *kb = b;
+    if (ka->pid != kb->pid) {
+        return (ka->pid > kb->pid) - (ka->pid < kb->pid);
+    }
+    return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+static int sort_rows(struct process *rows, int count) {
+    /* qsort is not stable - the keys are sorted instead and the rows get moved along the cycles of the permutation */
+    struct sort_key *keys = malloc((count > 0 ? count : 1) * sizeof *keys);
+    if (keys == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) {
+        keys[i].pid = rows[i].pid;
+        keys[i].index = i;
+    }
+    qsort(keys, count, sizeof *keys, compare_key);
+    /* row i has to become the row at keys[i].index - a key that points at itself marks a row that is in place */
+    for (int i = 0; i < count; ++i) {
+        if (keys[i].index == i) {
+            continue;
+        }
+        struct process first = rows[i];
+        int j = i;
+        while (keys[j].index != i) {
+            int source = keys[j].index;
+            rows[j] = rows[source];
+            keys[j].index = j;
+            j = source;
+        }
+        rows[j] = first;
+        keys[j].index = j;
+    }
+    free(keys);
+    return 0;
+}
+
+int column_build(struct column_store *store, struct process *rows, int count, const struct column_dict *dict) {
+    if (sort_rows(rows, count) == -1) {
+        return -1;
+    }
+    store->count = count;
+    store->dict = dict;
+    store->block_count = (count + COLUMN_BLOCK_ROWS - 1) / COLUMN_BLOCK_ROWS;
+    /* blocks and words are the big regions that get scanned - they may be backed by huge pages */
+    store->blocks = region_alloc(store->block_count * sizeof *store->blocks);
+    uint32_t *ids = malloc((count > 0 ? count : 1) * sizeof *ids);
+    if (store->blocks == NULL || ids == NULL) {
+        free(ids);
+        column_free(store);
+        return -1;
+    }
+
+    /* first pass - calculate the headers and the number of bits of every block */
+    uint64_t total_bits = 0;
+    for (size_t b = 0; b < store->block_count; ++b) {
+        struct column_block *block = &store->blocks[b];
+        int first = b * COLUMN_BLOCK_ROWS;
+        int last = first + COLUMN_BLOCK_ROWS < count ? first + COLUMN_BLOCK_ROWS : count;
+        block->count = last - first;
+        block->pid_min = rows[first].pid;
+        block->pid_max = rows[last - 1].pid;
+        uint64_t max_delta = 0;
+        uint32_t command_max = 0;
+        block->command_min = UINT32_MAX;
+        for (int f = 0; f < COLUMN_FIELDS; ++f) {
+            block->min[f] = INT_MAX;
+            block->max[f] = INT_MIN;
+            block->sum[f] = 0;
+        }
+        for (int i = first; i < last; ++i) {
+            int values[COLUMN_FIELDS] = {rows[i].p_cpu, rows[i].p_mem, rows[i].p_time};
+            for (int f = 0; f < COLUMN_FIELDS; ++f) {
+                if (values[f] < block->min[f]) {
+                    block->min[f] = values[f];
+                }
+                if (values[f] > block->max[f]) {
+                    block->max[f] = values[f];
+                }
+                block->sum[f] += values[f];
+            }
+            if (i > first) {
+                uint64_t delta = (uint64_t) ((long long) rows[i].pid - rows[i - 1].pid);
+                if (delta > max_delta) {
+                    max_delta = delta;
+                }
+            }
+            long id = dict_find_offset(dict, rows[i].p_command_offset);
+            if (id < 0) {
+                free(ids);
+                column_free(store);
+                return -1;
+            }
+            ids[i] = id;
+            if (ids[i] < block->command_min) {
+                block->command_min = ids[i];
+            }
+            if (ids[i] > command_max) {
+                command_max = ids[i];
+            }
+        }
+        block->pid_bits = bits_needed(max_delta);
+        for (int f = 0; f < COLUMN_FIELDS; ++f) {
+            block->field_bits[f] = bits_needed((uint64_t) ((long long) block->max[f] - block->min[f]));
+        }
+        block->command_bits = bits_needed(command_max - block->command_min);
+        block->bit_offset = total_bits;
+        total_bits += (uint64_t) block->count * (block->pid_bits + block->field_bits[0] + block->field_bits[1] + block->field_bits[2] + block->command_bits);
+    }
+
+    /* second pass - pack the values, one word more so bits_get never reads beyond the words */
+    store->word_count = (total_bits + 63) / 64 + 1;
+    store->words = region_alloc(store->word_count * sizeof *store->words);
+    if (store->words == NULL) {
+        free(ids);
+        column_free(store);
+        return -1;
+    }
+    for (size_t b = 0; b < store->block_count; ++b) {
+        struct column_block *block = &store->blocks[b];
+        int first = b * COLUMN_BLOCK_ROWS;
+        uint64_t pos[COLUMN_FIELDS + 2];
+        for (int c = 0; c < COLUMN_FIELDS + 2; ++c) {
+            pos[c] = block_column_pos(block, c);
+        }
+        for (uint32_t j = 0; j < block->count; ++j) {
+            const struct process *row = &rows[first + j];
+            int values[COLUMN_FIELDS] = {row->p_cpu, row->p_mem, row->p_time};
+            uint64_t delta = j == 0 ? 0 : (uint64_t) ((long long) row->pid - rows[first + j - 1].pid);
+            bits_put(store->words, pos[0] + (uint64_t) j * block->pid_bits, block->pid_bits, delta);
+            for (int f = 0; f < COLUMN_FIELDS; ++f) {
+                bits_put(store->words, pos[f + 1] + (uint64_t) j * block->field_bits[f], block->field_bits[f], (uint64_t) ((long long) values[f] - block->min[f]));
+            }
+            bits_put(store->words, pos[COLUMN_FIELDS + 1] + (uint64_t) j * block->command_bits, block->command_bits, ids[first + j] - block->command_min);
+        }
+    }
+    free(ids);
+    return 0;
+}
+
+int column_lookup(const struct column_store *store, int pid, struct process *row) {
+    /* search the first block whose pid range ends at or after pid - all other blocks get skipped */
+    size_t lo = 0;
+    size_t hi = store->block_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (store->blocks[mid].pid_max < pid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == store->block_count || store->blocks[lo].pid_min > pid) {
+        return FALSE;
+    }
+    const struct column_block *block = &store->blocks[lo];
+    long long current = block->pid_min;
+    for (uint32_t j = 0; j < block->count; ++j) {
+        current += (long long) bits_get(store->words, block->bit_offset + (uint64_t) j * block->pid_bits, block->pid_bits);
+        if (current == pid) {
+            row->pid = pid;
+            block_decode_row(store, block, j, row);
+            return TRUE;
+        }
+        if (current > pid) {
+            break;
+        }
+    }
+    return FALSE;
+}
+
+long long column_aggregate(const struct column_store *store, int command, int field) {
+    int min = INT_MAX;
+    int max = INT_MIN;
+    long long sum = 0;
+    for (size_t b = 0; b < store->block_count; ++b) {
+        const struct column_block *block = &store->blocks[b];
+        if (block->min[field] < min) {
+            min = block->min[field];
+        }
+        if (block->max[field] > max) {
+            max = block->max[field];
+        }
+        sum += block->sum[field];
+    }
+    if (command == 0) {
+        return min;
+    } else if (command == 1) {
+        return max;
+    } else if (command == 2) {
+        return sum;
+    }
+    return store->count > 0 ? sum / store->count : 0;
+}
+
+void column_stats(const struct column_store *store, int fields, int min[COLUMN_FIELDS], int max[COLUMN_FIELDS], long long sum[COLUMN_FIELDS]) {
+    for (int f = 0; f < COLUMN_FIELDS; ++f) {
+        min[f] = INT_MAX;
+        max[f] = INT_MIN;
+        sum[f] = 0;
+    }
+    for (size_t b = 0; b < store->block_count; ++b) {
+        const struct column_block *block = &store->blocks[b];
+        for (int f = 0; f < COLUMN_FIELDS; ++f) {
+            if (fields & (1 << f)) {
+                if (block->min[f] < min[f]) {
+                    min[f] = block->min[f];
+                }
+                if (block->max[f] > max[f]) {
+                    max[f] = block->max[f];
+                }
+                sum[f] += block->sum[f];
+            }
+        }
+    }
+}
+
+void column_iterator_init(struct column_iterator *iterator, const struct column_store *store, int index) {
+    iterator->store = store;
+    iterator->index = index;
+    iterator->block = -1;
+}
+
+int column_iterator_next(struct column_iterator *iterator, struct process *row) {
+    const struct column_store *store = iterator->store;
+    if (iterator->index >= store->count) {
+        return FALSE;
+    }
+    long b = iterator->index / COLUMN_BLOCK_ROWS;
+    const struct column_block *block = &store->blocks[b];
+    if (b != iterator->block) {
+        block_decode_pids(store, block, iterator->pids);
+        iterator->block = b;
+    }
+    uint32_t j = iterator->index % COLUMN_BLOCK_ROWS;
+    row->pid = iterator->pids[j];
+    block_decode_row(store, block, j, row);
+    ++iterator->index;
+    return TRUE;
+}
+
+size_t column_memory(const struct column_store *store) {
+    size_t bytes = store->block_count * sizeof *store->blocks + store->word_count * sizeof *store->words;
+    if (store->dict != NULL) {
+        bytes += store->dict->capacity * (sizeof *store->dict->offset + sizeof *store->dict->length);
+        bytes += (store->dict->slot_mask + 1) * sizeof *store->dict->slots;
+    }
+    return bytes;
+}
+
+void column_free(struct column_store *store) {
+    region_free(store->blocks, store->block_count * sizeof *store->blocks);
+    region_free(store->words, store->word_count * sizeof *store->words);
+    store->blocks = NULL;
+    store->words = NULL;
+    store->block_count = 0;
+    store->word_count = 0;
+    store->count = 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file procdb-column.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief compressed column storage for the process-database of procdb-server
+ *
+ * @details the rows get sorted by pid - rows with the same pid keep the order they were loaded in, so a lookup returns the first row of a pid like the pid index of the uncompressed layout - and split into blocks of COLUMN_BLOCK_ROWS rows. inside a block the pids are stored as bit-packed deltas, cpu, mem and time as bit-packed offsets to the minimum of the block (frame of reference) and the command lines as bit-packed ids into a dictionary. every block has a header with min, max and sum of every field so aggregates never have to decode a block and lookups can skip every block whose pid range does not fit.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_COLUMN_H
+#define PROCDB_COLUMN_H
+
+#include "procdb.h"
+#include <stdint.h>
+
+/**
+ * @brief number of rows in one compressed block
+ */
+#define COLUMN_BLOCK_ROWS (128)
+
+/**
+ * @brief number of numeric fields in a row - 0 - cpu, 1 - mem, 2 - time
+ */
+#define COLUMN_FIELDS (3)
+
+/**
+ * @brief column_dict is the dictionary of distinct command lines - the strings themselves are stored in the string heap
+ */
+struct column_dict {
+    /* number of distinct command lines */
+    uint32_t count;
+    /* number of entries offset and length have space for */
+    uint32_t capacity;
+    /* offset of every command line in the string heap - ids are given in the order the strings get appended so offsets are ascending */
+    size_t *offset;
+    /* length of every command line */
+    size_t *length;
+    /* open addressing hash table of id+1 - 0 marks an empty slot */
+    uint32_t *slots;
+    /* number of slots - 1, the number of slots is always a power of 2 */
+    uint32_t slot_mask;
+};
+
+/**
+ * @brief column_block is the header of a compressed block
+ */
+struct column_block {
+    /* pid of the first and the last row - the rows are sorted by pid */
+    int pid_min;
+    int pid_max;
+    /* minimum, maximum and sum of cpu, mem and time over the block */
+    int min[COLUMN_FIELDS];
+    int max[COLUMN_FIELDS];
+    long long sum[COLUMN_FIELDS];
+    /* smallest command id in the block - the ids get stored relative to it */
+    uint32_t command_min;
+    /* number of rows in the block */
+    uint32_t count;
+    /* number of bits per value for the pid deltas, the fields and the command ids */
+    unsigned char pid_bits;
+    unsigned char field_bits[COLUMN_FIELDS];
+    unsigned char command_bits;
+    /* position of the first bit of the block in the packed words */
+    uint64_t bit_offset;
+};
+
+/**
+ * @brief column_store is the compressed version of the list of processes
+ */
+struct column_store {
+    /* number of rows */
+    int count;
+    /* headers of the blocks */
+    struct column_block *blocks;
+    size_t block_count;
+    /* bit-packed data of all blocks */
+    uint64_t *words;
+    size_t word_count;
+    /* dictionary the command ids refer to */
+    const struct column_dict *dict;
+};
+
+/**
+ * @brief column_iterator decodes the rows of a store one after the other - the pids of a block get decoded once for all its rows
+ */
+struct column_iterator {
+    const struct column_store *store;
+    /* index of the next row in pid order */
+    int index;
+    /* block the pids got decoded of - -1 if none yet */
+    long block;
+    /* pids of the rows of that block */
+    int pids[COLUMN_BLOCK_ROWS];
+};
+
+/**
+ * @brief initializes an empty dictionary
+ * @param dict dictionary to initialize
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int column_dict_init(struct column_dict *dict);
+
+/**
+ * @brief searches a command line in the dictionary
+ * @param dict dictionary to search
+ * @param heap_data data of the string heap the offsets refer to
+ * @param str command line to search (does not need to be null terminated)
+ * @param length length of str
+ * @return id of the command line or -1 if it is not in the dictionary
+ */
+long column_dict_find(const struct column_dict *dict, const char *heap_data, const char *str, size_t length);
+
+/**
+ * @brief adds a command line that got appended to the string heap to the dictionary
+ * @param dict dictionary to add to
+ * @param heap_data data of the string heap the offsets refer to
+ * @param offset offset of the command line in the string heap - must be larger than every offset already in the dictionary
+ * @param length length of the command line
+ * @return id of the command line or -1 if memory could not be allocated
+ */
+long column_dict_add(struct column_dict *dict, const char *heap_data, size_t offset, size_t length);
+
+/**
+ * @brief frees the memory of a dictionary
+ * @param dict dictionary to free
+ */
+void column_dict_free(struct column_dict *dict);
+
+/**
+ * @brief builds the compressed columns out of a list of processes - the list gets sorted by pid, rows with the same pid keep their order
+ * @param store store to build
+ * @param rows list of processes - every command line has to be in dict
+ * @param count number of processes
+ * @param dict dictionary of the command lines
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int column_build(struct column_store *store, struct process *rows, int count, const struct column_dict *dict);
+
+/**
+ * @brief looks up the first row with a pid
+ * @param store store to search
+ * @param pid pid to look for
+ * @param row gets filled with the decoded row if it was found
+ * @return TRUE if the pid was found - otherwise FALSE
+ */
+int column_lookup(const struct column_store *store, int pid, struct process *row);
+
+/**
+ * @brief calculates min/max/sum/avg over all rows using only the block headers
+ * @param store store to calculate over
+ * @param command 0 - min, 1 - max, 2 - sum, 3 - avg
+ * @param field 0 - cpu, 1 - mem, 2 - time
+ * @return the result
+ */
+long long column_aggregate(const struct column_store *store, int command, int field);
+
+/**
+ * @brief calculates min, max and sum of several fields in one pass over the block headers
+ * @param store store to calculate over
+ * @param fields bitmask of the fields - 1 - cpu, 2 - mem, 4 - time
+ * @param min gets filled with the minimum of every field in fields
+ * @param max gets filled with the maximum of every field in fields
+ * @param sum gets filled with the sum of every field in fields
+ */
+void column_stats(const struct column_store *store, int fields, int min[COLUMN_FIELDS], int max[COLUMN_FIELDS], long long sum[COLUMN_FIELDS]);
+
+/**
+ * @brief starts an iterator at a row
+ * @param iterator iterator to start
+ * @param store store to iterate over
+ * @param index index of the first row to return in pid order
+ */
+void column_iterator_init(struct column_iterator *iterator, const struct column_store *store, int index);
+
+/**
+ * @brief decodes the next row of an iterator
+ * @param iterator iterator to advance
+ * @param row gets filled with the decoded row
+ * @return TRUE if a row got decoded - FALSE at the end of the store
+ */
+int column_iterator_next(struct column_iterator *iterator, struct process *row);
+
+/**
+ * @brief returns the number of bytes the store and its dictionary use (without the strings in the string heap)
+ * @param store store to measure
+ * @return number of bytes
+ */
+size_t column_memory(const struct column_store *store);
+
+/**
+ * @brief frees the memory of a store - the dictionary does not get freed
+ * @param store store to free
+ */
+void column_free(struct column_store *store);
+
+#endif
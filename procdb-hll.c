@@ -0,0 +1,136 @@
+/**
+ * @file procdb-hll.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief HyperLogLog sketches for approximate distinct counts of procdb-server
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "procdb-hll.h"
+
+/**
+ * @brief number of hash bits that are left for the rank - a register holds 0 to HLL_RANK_BITS + 1
+ */
+#define HLL_RANK_BITS (64 - HLL_PRECISION)
+
+/**
+ * @brief mixes the bits of a hash so every input bit changes every output bit with probability 1/2 (finalizer of MurmurHash3)
+ * @param h value to mix
+ * @return mixed value
+ */
+static uint64_t mix(uint64_t h);
+
+/**
+ * @brief sigma of the estimator - corrects for registers that are still 0
+ * @param x share of the registers that are 0
+ * @return sigma(x)
+ */
+static double sigma(double x);
+
+/**
+ * @brief tau of the estimator - corrects for registers that hold the highest possible rank
+ * @param x share of the registers that do not hold the highest possible rank
+ * @return tau(x)
+ */
+static double tau(double x);
+
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void hll_clear(struct hll *sketch) {
+    memset(sketch->registers, 0, sizeof sketch->registers);
+}
+
+uint64_t hll_hash(const char *data, size_t length) {
+    /* FNV-1a is fast on short command lines but its high bits are weak - mix spreads them */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= (unsigned char) data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return mix(h ^ length);
+}
+
+uint64_t hll_hash_int(int value) {
+    return mix((uint64_t) (uint32_t) value + 0x9E3779B97F4A7C15ULL);
+}
+
+void hll_add(struct hll *sketch, uint64_t hash) {
+    uint32_t index = (uint32_t) (hash >> HLL_RANK_BITS);
+    /* the extra bit stops the count at HLL_RANK_BITS if all remaining bits are 0 */
+    uint8_t rank = (uint8_t) (__builtin_clzll((hash << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1))) + 1);
+    if (rank > sketch->registers[index]) {
+        sketch->registers[index] = rank;
+    }
+}
+
+void hll_merge(struct hll *into, const struct hll *other) {
+    for (int i = 0; i < HLL_REGISTERS; ++i) {
+        if (other->registers[i] > into->registers[i]) {
+            into->registers[i] = other->registers[i];
+        }
+    }
+}
+
+static double sigma(double x) {
+    if (x == 1.0) {
+        return INFINITY;
+    }
+    double y = 1.0;
+    double z = x;
+    double previous;
+    do {
+        x *= x;
+        previous = z;
+        z += x * y;
+        y += y;
+    } while (z != previous);
+    return z;
+}
+
+static double tau(double x) {
+    if (x == 0.0 || x == 1.0) {
+        return 0.0;
+    }
+    double y = 1.0;
+    double z = 1.0 - x;
+    double previous;
+    do {
+        x = sqrt(x);
+        previous = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != previous);
+    return z / 3.0;
+}
+
+double hll_estimate(const struct hll *sketch) {
+    /*
+     * improved estimator of Ertl (New cardinality estimation algorithms for HyperLogLog sketches, 2017) - it needs no
+     * switch to linear counting for small sets and no table of empirical bias corrections
+     */
+    int histogram[HLL_RANK_BITS + 2] = {0};
+    for (int i = 0; i < HLL_REGISTERS; ++i) {
+        ++histogram[sketch->registers[i]];
+    }
+    const double m = HLL_REGISTERS;
+    double z = m * tau(1.0 - histogram[HLL_RANK_BITS + 1] / m);
+    for (int k = HLL_RANK_BITS; k >= 1; --k) {
+        z = 0.5 * (z + histogram[k]);
+    }
+    z += m * sigma(histogram[0] / m);
+    return m * m / (2.0 * log(2.0) * z);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file procdb-hll.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief HyperLogLog sketches for approximate distinct counts of procdb-server
+ *
+ * @details a sketch has 2^HLL_PRECISION registers of one byte. a value gets hashed to 64 bits - the first HLL_PRECISION bits pick the register, the register keeps the highest number of leading zeros + 1 of the remaining bits. the standard error of an estimate is 1.04 / sqrt(HLL_REGISTERS), about 0.81%. two sketches get merged by taking the maximum of every register, so sketches of parts of the data (time windows, shards) combine to the sketch of the whole.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_HLL_H
+#define PROCDB_HLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief number of hash bits that pick the register
+ */
+#define HLL_PRECISION (14)
+
+/**
+ * @brief number of registers of a sketch
+ */
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+/**
+ * @brief hll is a sketch of a set of values
+ */
+struct hll {
+    uint8_t registers[HLL_REGISTERS];
+};
+
+/**
+ * @brief empties a sketch
+ * @param sketch sketch to empty
+ */
+void hll_clear(struct hll *sketch);
+
+/**
+ * @brief hashes a string for a sketch
+ * @param data string to hash (does not need to be null terminated)
+ * @param length length of data
+ * @return 64 bit hash
+ */
+uint64_t hll_hash(const char *data, size_t length);
+
+/**
+ * @brief hashes an int for a sketch
+ * @param value int to hash
+ * @return 64 bit hash
+ */
+uint64_t hll_hash_int(int value);
+
+/**
+ * @brief adds a value to a sketch
+ * @param sketch sketch to add to
+ * @param hash hash of the value - see hll_hash and hll_hash_int
+ */
+void hll_add(struct hll *sketch, uint64_t hash);
+
+/**
+ * @brief merges a sketch into another one - afterwards into is the sketch of both sets
+ * @param into sketch to merge into
+ * @param other sketch to merge
+ */
+void hll_merge(struct hll *into, const struct hll *other);
+
+/**
+ * @brief estimates the number of distinct values of a sketch
+ * @param sketch sketch to estimate
+ * @return the estimate
+ */
+double hll_estimate(const struct hll *sketch);
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file procdb-index.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief hash index from pid to the position of the process in the list of processes of procdb-server
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb-index.h"
+#include "procdb-memory.h"
+#include <stdint.h>
+
+/**
+ * @brief initial number of slots of an index
+ */
+#define INDEX_INITIAL_SLOTS (1024)
+
+/**
+ * @brief returns the home slot of a pid
+ * @param index index the slot belongs to
+ * @param pid pid to hash
+ * @return position of the slot
+ */
+static size_t home_slot(const struct pid_index *index, int pid);
+
+/**
+ * @brief doubles the number of slots of an index
+ * @param index index to grow
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+static int grow(struct pid_index *index);
+
+
+static size_t home_slot(const struct pid_index *index, int pid) {
+    /* pids are often dense - multiplying spreads neighbouring pids over the table */
+    uint64_t hash = (uint64_t) (uint32_t) pid * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (hash >> 32) & index->mask;
+}
+
+int pid_index_init(struct pid_index *index) {
+    index->pids = region_alloc(INDEX_INITIAL_SLOTS * sizeof *index->pids);
+    index->rows = region_alloc(INDEX_INITIAL_SLOTS * sizeof *index->rows);
+    index->mask = INDEX_INITIAL_SLOTS - 1;
+    index->count = 0;
+    if (index->pids == NULL || index->rows == NULL) {
+        pid_index_free(index);
+        return -1;
+    }
+    return 0;
+}
+
+int pid_index_find(const struct pid_index *index, int pid) {
+    for (size_t slot = home_slot(index, pid); index->rows[slot] != 0; slot = (slot + 1) & index->mask) {
+        if (index->pids[slot] == pid) {
+            return index->rows[slot] - 1;
+        }
+    }
+    return -1;
+}
+
+static int grow(struct pid_index *index) {
+    struct pid_index grown;
+    size_t slots = (index->mask + 1) * 2;
+    grown.pids = region_alloc(slots * sizeof *grown.pids);
+    grown.rows = region_alloc(slots * sizeof *grown.rows);
+    grown.mask = slots - 1;
+    grown.count = 0;
+    if (grown.pids == NULL || grown.rows == NULL) {
+        pid_index_free(&grown);
+        return -1;
+    }
+    for (size_t slot = 0; slot <= index->mask; ++slot) {
+        if (index->rows[slot] != 0) {
+            size_t new_slot = home_slot(&grown, index->pids[slot]);
+            while (grown.rows[new_slot] != 0) {
+                new_slot = (new_slot + 1) & grown.mask;
+            }
+            grown.pids[new_slot] = index->pids[slot];
+            grown.rows[new_slot] = index->rows[slot];
+            ++grown.count;
+        }
+    }
+    pid_index_free(index);
+    *index = grown;
+    return 0;
+}
+
+int pid_index_put(struct pid_index *index, int pid, int row) {
+    /* keep the table at most half full so probe sequences stay short */
+    if ((index->count + 1) * 2 > index->mask + 1 && grow(index) == -1) {
+        return -1;
+    }
+    size_t slot = home_slot(index, pid);
+    while (index->rows[slot] != 0 && index->pids[slot] != pid) {
+        slot = (slot + 1) & index->mask;
+    }
+    if (index->rows[slot] == 0) {
+        ++index->count;
+    }
+    index->pids[slot] = pid;
+    index->rows[slot] = row + 1;
+    return 0;
+}
+
+void pid_index_remove(struct pid_index *index, int pid) {
+    size_t slot = home_slot(index, pid);
+    while (index->rows[slot] != 0 && index->pids[slot] != pid) {
+        slot = (slot + 1) & index->mask;
+    }
+    if (index->rows[slot] == 0) {
+        return;
+    }
+    /* shift every following entry of the probe sequence back if its home slot allows it */
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & index->mask; index->rows[next] != 0; next = (next + 1) & index->mask) {
+        size_t home = home_slot(index, index->pids[next]);
+        if (((next - home) & index->mask) >= ((next - hole) & index->mask)) {
+            index->pids[hole] = index->pids[next];
+            index->rows[hole] = index->rows[next];
+            hole = next;
+        }
+    }
+    index->rows[hole] = 0;
+    --index->count;
+}
+
+size_t pid_index_memory(const struct pid_index *index) {
+    return (index->mask + 1) * (sizeof *index->pids + sizeof *index->rows);
+}
+
+void pid_index_free(struct pid_index *index) {
+    region_free(index->pids, (index->mask + 1) * sizeof *index->pids);
+    region_free(index->rows, (index->mask + 1) * sizeof *index->rows);
+    index->pids = NULL;
+    index->rows = NULL;
+    index->count = 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file procdb-index.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief hash index from pid to the position of the process in the list of processes of procdb-server
+ *
+ * @details open addressing with linear probing - removing an entry shifts the following entries back so no tombstones are needed
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_INDEX_H
+#define PROCDB_INDEX_H
+
+#include <stddef.h>
+
+/**
+ * @brief pid_index maps a pid to the position of its row
+ */
+struct pid_index {
+    /* pids of the slots */
+    int *pids;
+    /* position of the row + 1 - 0 marks an empty slot */
+    int *rows;
+    /* number of slots - 1, the number of slots is always a power of 2 */
+    size_t mask;
+    /* number of used slots */
+    size_t count;
+};
+
+/**
+ * @brief initializes an empty index
+ * @param index index to initialize
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int pid_index_init(struct pid_index *index);
+
+/**
+ * @brief searches a pid
+ * @param index index to search
+ * @param pid pid to look for
+ * @return position of the row or -1 if the pid is not in the index
+ */
+int pid_index_find(const struct pid_index *index, int pid);
+
+/**
+ * @brief adds a pid or changes the position of its row
+ * @param index index to add to
+ * @param pid pid to add
+ * @param row position of the row
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int pid_index_put(struct pid_index *index, int pid, int row);
+
+/**
+ * @brief removes a pid - does nothing if the pid is not in the index
+ * @param index index to remove from
+ * @param pid pid to remove
+ */
+void pid_index_remove(struct pid_index *index, int pid);
+
+/**
+ * @brief returns the number of bytes the index uses
+ * @param index index to measure
+ * @return number of bytes
+ */
+size_t pid_index_memory(const struct pid_index *index);
+
+/**
+ * @brief frees the memory of an index
+ * @param index index to free
+ */
+void pid_index_free(struct pid_index *index);
+
+#endif
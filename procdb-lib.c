@@ -0,0 +1,804 @@
+/**
+ * @file procdb-lib.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief libprocdb is the client library of procdb - it talks to procdb-server via shared memory without any string formatting
+ *
+ * @details every connection has a local queue of PROCDB_QUEUE_SIZE requests. a request gets handed to the server as soon as it got a request slot, the result gets copied out when it gets collected and the slot is free again right away.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb.h"
+#include "libprocdb.h"
+
+/**
+ * @brief states of a request in the local queue - free, waiting for a request slot, handed to the server
+ */
+#define PENDING_FREE (0)
+#define PENDING_QUEUED (1)
+#define PENDING_SUBMITTED (2)
+
+/**
+ * @brief internal query types - next page of a scan, pin of an epoch
+ */
+#define PROCDB_QUERY_SCAN (100)
+#define PROCDB_QUERY_PIN (101)
+
+/**
+ * @brief a binary scan page gets handed out as struct procdb_row - it has to look exactly like struct process
+ */
+typedef char procdb_row_matches_process[sizeof(struct procdb_row) == sizeof(struct process) ? 1 : -1];
+
+/**
+ * @brief the status codes and constants of the server get handed out as they are
+ */
+typedef char procdb_status_matches_server[PROCDB_INVALID == STATUS_INVALID && PROCDB_NO_EPOCH == STATUS_NO_EPOCH && PROCDB_ABOVE == WATCH_ABOVE && PROCDB_SCAN_CSV == SCAN_CSV
+    && PROCDB_COMMAND == DISTINCT_COMMAND && PROCDB_PID == DISTINCT_PID && PROCDB_DISTINCT_WINDOWS * 60 == DISTINCT_WINDOWS * DISTINCT_WINDOW_SECONDS ? 1 : -1];
+
+/**
+ * @brief pending is a request in the local queue of a connection
+ */
+struct pending {
+    /* PENDING_FREE, PENDING_QUEUED or PENDING_SUBMITTED */
+    int state;
+    struct procdb_query query;
+    /* scan the page belongs to - only for PROCDB_QUERY_SCAN */
+    struct procdb_scan *scan;
+    /* slot and lease word of the slot after the request was handed over - only if submitted */
+    struct request_slot *slot;
+    uint64_t request;
+    /* order of submission - queued requests get handed over oldest first */
+    unsigned long sequence;
+};
+
+/**
+ * @brief procdb is a connection to the server
+ */
+struct procdb {
+    /* the shared memory of the server */
+    struct shm_struct *shm;
+    /* read-only mapping of the string heap - NULL as long as it is not mapped */
+    const struct string_heap *heap;
+    size_t heap_mapped;
+    /* first step of the polling backoff - with PROCDB_BUSY_POLL 0 (or the yields on a machine with one cpu), otherwise the client parks right away */
+    int poll_start;
+    pid_t self;
+    unsigned long sequence;
+    struct pending pending[PROCDB_QUEUE_SIZE];
+    /* number of events read per watch */
+    uint64_t watch_tail[WATCH_COUNT];
+};
+
+/**
+ * @brief returns the current CLOCK_MONOTONIC time
+ * @return time in ns
+ */
+static long long monotonic_ns(void);
+
+/**
+ * @brief returns the CLOCK_REALTIME time some milliseconds from now - used for sem_timedwait
+ * @param ms milliseconds from now
+ * @param timeout gets filled with the time
+ */
+static void realtime_in(int ms, struct timespec *timeout);
+
+/**
+ * @brief checks if the server is still running
+ * @param db connection to check
+ * @return 0 if it is running or -1 if it is down (errno is set to EPIPE)
+ */
+static int check_server(struct procdb *db);
+
+/**
+ * @brief claims a free request slot - does not wait if all are taken
+ * @param db connection to claim for
+ * @param lease gets set to the lease word of the claimed slot
+ * @return the claimed slot or NULL if all are taken
+ */
+static struct request_slot *try_claim(struct procdb *db, uint64_t *lease);
+
+/**
+ * @brief hands the queued requests to the server (oldest first) as long as request slots are free
+ * @param db connection of the requests
+ * @return 0 on success or -1 if a slot got reclaimed before the request was handed over (errno is set)
+ */
+static int start_queued(struct procdb *db);
+
+/**
+ * @brief writes a request into its slot and hands it to the server
+ * @param db connection of the request
+ * @param p request to hand over
+ * @param slot claimed slot
+ * @param lease lease word of the claimed slot
+ * @return 0 on success or -1 if the slot got reclaimed in the meantime (errno is set)
+ */
+static int hand_over(struct procdb *db, struct pending *p, struct request_slot *slot, uint64_t lease);
+
+/**
+ * @brief returns the lease word a slot gets once the response of a request is ready
+ * @param p request that was handed over
+ * @return lease word
+ */
+static uint64_t response_lease(const struct pending *p);
+
+/**
+ * @brief waits until the response of a request that was handed over is ready
+ * @param db connection of the request
+ * @param p request to wait for
+ * @return 0 if the response is ready or -1 on error (errno is set)
+ */
+static int wait_slot(struct procdb *db, struct pending *p);
+
+/**
+ * @brief gives the slot of a request with a ready response back
+ * @param p request with a ready response
+ * @return 0 on success or -1 if the server reclaimed the slot in the meantime (errno is set)
+ */
+static int give_back(struct pending *p);
+
+/**
+ * @brief copies the result of a request out of its slot and gives the slot back
+ * @param db connection of the request
+ * @param p request with a ready response
+ * @param result gets filled with the result
+ * @return 0 on success, 1 if the request got overwritten by a stalled client and was queued again or -1 if the server reclaimed the slot before the result was copied (errno is set)
+ */
+static int complete(struct procdb *db, struct pending *p, struct procdb_result *result);
+
+/**
+ * @brief puts a request into the local queue and hands it to the server if a request slot is free
+ * @param db connection of the request
+ * @param query query of the request - gets copied
+ * @param scan scan the page belongs to - only for PROCDB_QUERY_SCAN
+ * @return ticket of the request or -1 on error (errno is set)
+ */
+static int enqueue(struct procdb *db, const struct procdb_query *query, struct procdb_scan *scan);
+
+/**
+ * @brief checks the arguments of a query - a query the server would answer with PROCDB_INVALID does not get sent
+ * @param query query to check
+ * @return TRUE if the query is valid
+ */
+static int valid_query(const struct procdb_query *query);
+
+/**
+ * @brief returns a request of the local queue
+ * @param db connection of the request
+ * @param ticket ticket of the request
+ * @return the request or NULL if the ticket is not in use (errno is set)
+ */
+static struct pending *find_pending(struct procdb *db, int ticket);
+
+
+static long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void realtime_in(int ms, struct timespec *timeout) {
+    clock_gettime(CLOCK_REALTIME, timeout);
+    timeout->tv_nsec += ms * 1000000L;
+    timeout->tv_sec += timeout->tv_nsec / 1000000000L;
+    timeout->tv_nsec %= 1000000000L;
+}
+
+static int check_server(struct procdb *db) {
+    if (kill(db->shm->server_pid, 0) == -1 && errno == ESRCH) {
+        errno = EPIPE;
+        return -1;
+    }
+    return 0;
+}
+
+struct procdb *procdb_connect(int flags) {
+    struct procdb *db = calloc(1, sizeof *db);
+    if (db == NULL) {
+        return NULL;
+    }
+    int shmfd = shm_open(SHM_SERVER, O_RDWR, PERMISSION);
+    if (shmfd == -1) {
+        free(db);
+        return NULL;
+    }
+    db->shm = mmap(NULL, sizeof *db->shm, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    int saved = errno;
+    (void) close(shmfd);
+    if (db->shm == MAP_FAILED) {
+        errno = saved;
+        free(db);
+        return NULL;
+    }
+    /* the semaphores in the shared memory can be used as soon as the server published its pid */
+    if (__atomic_load_n(&db->shm->server_pid, __ATOMIC_ACQUIRE) == 0) {
+        (void) munmap(db->shm, sizeof *db->shm);
+        free(db);
+        errno = EAGAIN;
+        return NULL;
+    }
+    db->self = getpid();
+    if (!(flags & PROCDB_BUSY_POLL)) {
+        db->poll_start = POLL_SPINS + POLL_PAUSES + POLL_YIELDS;
+    } else if (sysconf(_SC_NPROCESSORS_ONLN) == 1) {
+        /* with only one cpu spinning is skipped because the server can not run while we spin */
+        db->poll_start = POLL_SPINS + POLL_PAUSES;
+    }
+    return db;
+}
+
+void procdb_disconnect(struct procdb *db) {
+    if (db->heap != NULL) {
+        (void) munmap((void *) db->heap, db->heap_mapped);
+    }
+    (void) munmap(db->shm, sizeof *db->shm);
+    free(db);
+}
+
+static struct request_slot *try_claim(struct procdb *db, uint64_t *lease) {
+    /* start at a different slot in every client so they do not all fight for the first one */
+    for (int n = 0; n < SLOT_COUNT; ++n) {
+        struct request_slot *slot = &db->shm->slots[(db->self + n) % SLOT_COUNT];
+        uint64_t current = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+        if (LEASE_PID(current) != 0) {
+            continue;
+        }
+        uint64_t claimed = LEASE(LEASE_GENERATION(current) + 1, SLOT_CLAIMED, db->self);
+        if (__atomic_compare_exchange_n(&slot->lease, &current, claimed, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *lease = claimed;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static int hand_over(struct procdb *db, struct pending *p, struct request_slot *slot, uint64_t lease) {
+    const struct procdb_query *query = &p->query;
+    slot->write_op = 0;
+    slot->request_length = 0;
+    slot->pid_cmd = -1;
+    slot->info = query->field;
+    slot->pid = query->pid;
+    slot->epoch = query->epoch;
+    switch (query->type) {
+    case PROCDB_QUERY_FIELD:
+        break;
+    case PROCDB_QUERY_COMMAND:
+        slot->info = 3;
+        break;
+    case PROCDB_QUERY_AGGREGATE:
+        slot->pid = -2;
+        slot->pid_cmd = query->aggregate;
+        break;
+    case PROCDB_QUERY_STATS:
+        slot->pid = -3;
+        slot->stats_aggregates = query->aggregates;
+        slot->stats_fields = query->fields;
+        break;
+    case PROCDB_QUERY_WATCH:
+        slot->pid = -4;
+        slot->watch_pid = query->pid;
+        slot->watch_condition = query->condition;
+        slot->watch_threshold = query->threshold;
+        break;
+    case PROCDB_QUERY_SCAN:
+        slot->pid = -5;
+        slot->cursor = p->scan->cursor;
+        slot->format = p->scan->format;
+        slot->epoch = p->scan->epoch;
+        break;
+    case PROCDB_QUERY_PIN:
+        slot->pid = -6;
+        break;
+    case PROCDB_QUERY_DISTINCT:
+        slot->pid = -7;
+        slot->distinct_exact = query->exact;
+        slot->distinct_windows = query->windows;
+        break;
+    default:
+        /* insert, update or delete */
+        slot->write_op = query->type == PROCDB_QUERY_INSERT ? WRITE_INSERT : query->type == PROCDB_QUERY_UPDATE ? WRITE_UPDATE : WRITE_DELETE;
+        slot->epoch = 0;
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            slot->write_values[f] = query->values[f];
+        }
+        slot->request_length = query->command_length;
+        if (query->command_length > 0) {
+            (void) memcpy(slot->request_data, query->command, query->command_length);
+        }
+        break;
+    }
+    /* the client only parks (and wants a post) once it actually waits */
+    slot->client_parked = FALSE;
+    uint64_t request = LEASE(LEASE_GENERATION(lease), SLOT_REQUEST, LEASE_PID(lease));
+    slot->seal = request_seal(slot, request);
+    if (!__atomic_compare_exchange_n(&slot->lease, &lease, request, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        p->state = PENDING_FREE;
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    p->slot = slot;
+    p->request = request;
+    p->state = PENDING_SUBMITTED;
+    /* a busy polling server sees the request itself */
+    if (__atomic_load_n(&db->shm->server_parked, __ATOMIC_SEQ_CST) && sem_post(&db->shm->work) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+static int start_queued(struct procdb *db) {
+    while (TRUE) {
+        struct pending *oldest = NULL;
+        for (int i = 0; i < PROCDB_QUEUE_SIZE; ++i) {
+            if (db->pending[i].state == PENDING_QUEUED && (oldest == NULL || db->pending[i].sequence < oldest->sequence)) {
+                oldest = &db->pending[i];
+            }
+        }
+        if (oldest == NULL) {
+            return 0;
+        }
+        uint64_t lease;
+        struct request_slot *slot = try_claim(db, &lease);
+        if (slot == NULL) {
+            return 0;
+        }
+        if (hand_over(db, oldest, slot, lease) == -1) {
+            return -1;
+        }
+    }
+}
+
+static uint64_t response_lease(const struct pending *p) {
+    return LEASE(LEASE_GENERATION(p->request), SLOT_RESPONSE, LEASE_PID(p->request));
+}
+
+static int wait_slot(struct procdb *db, struct pending *p) {
+    struct request_slot *slot = p->slot;
+    uint64_t response = response_lease(p);
+    /* spin, then spin with pause, then yield - same backoff as the server */
+    for (int n = db->poll_start; n < POLL_SPINS + POLL_PAUSES + POLL_YIELDS; ++n) {
+        if (__atomic_load_n(&slot->lease, __ATOMIC_SEQ_CST) == response) {
+            return 0;
+        }
+        if (n >= POLL_SPINS + POLL_PAUSES) {
+            (void) sched_yield();
+        } else if (n >= POLL_SPINS) {
+            CPU_RELAX();
+        }
+    }
+    /* park - if the response arrived in the meantime only the side that takes the flag back decides if a post comes */
+    __atomic_store_n(&slot->client_parked, TRUE, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&slot->lease, __ATOMIC_SEQ_CST) == response && __atomic_exchange_n(&slot->client_parked, FALSE, __ATOMIC_SEQ_CST)) {
+        return 0;
+    }
+    while (TRUE) {
+        struct timespec timeout;
+        realtime_in(WAIT_INTERVAL_MS, &timeout);
+        if (sem_timedwait(&slot->response, &timeout) == 0) {
+            uint64_t current = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+            if (current == response) {
+                return 0;
+            }
+            if (current == p->request) {
+                /* a post of the client the slot got reclaimed from that the server did not drain yet - the response is still to come */
+                continue;
+            }
+            /* the slot got reclaimed while this client was stalled - the post belongs to the client that owns it now */
+            (void) sem_post(&slot->response);
+            p->state = PENDING_FREE;
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (errno != EINTR && errno != ETIMEDOUT) {
+            return -1;
+        }
+        uint64_t current = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+        if (current != p->request && current != response) {
+            p->state = PENDING_FREE;
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (check_server(db) == -1) {
+            return -1;
+        }
+    }
+}
+
+static int give_back(struct pending *p) {
+    p->state = PENDING_FREE;
+    uint64_t response = response_lease(p);
+    if (!__atomic_compare_exchange_n(&p->slot->lease, &response, LEASE(LEASE_GENERATION(p->request), SLOT_FREE, 0), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+static int complete(struct procdb *db, struct pending *p, struct procdb_result *result) {
+    struct request_slot *slot = p->slot;
+    if (slot->status == STATUS_OVERWRITTEN) {
+        /* the server did nothing - the request goes back into the queue as it was and gets handed over again */
+        if (give_back(p) == -1) {
+            return -1;
+        }
+        p->state = PENDING_QUEUED;
+        return start_queued(db) == -1 ? -1 : 1;
+    }
+    memset(result, 0, sizeof *result);
+    result->status = STATUS_OK;
+    result->value = slot->value_d;
+    /* a read of an epoch that is not kept anymore or a read the server found invalid has no result */
+    switch (slot->status != STATUS_OK ? 0 : p->query.type) {
+    case 0:
+        result->status = slot->status;
+        break;
+    case PROCDB_QUERY_FIELD:
+        if (slot->value_d == -1) {
+            result->status = STATUS_NOT_FOUND;
+        }
+        break;
+    case PROCDB_QUERY_COMMAND:
+        if (slot->value_d == -1) {
+            result->status = STATUS_NOT_FOUND;
+        } else {
+            result->command_length = slot->value_length;
+            result->command = procdb_string(db, slot->value_offset, slot->value_length);
+            if (result->command == NULL) {
+                return -1;
+            }
+        }
+        break;
+    case PROCDB_QUERY_STATS:
+        (void) memcpy(result->stats, slot->stats, sizeof result->stats);
+        break;
+    case PROCDB_QUERY_WATCH:
+    case PROCDB_QUERY_DISTINCT:
+        if (slot->value_d == -1) {
+            result->status = STATUS_INVALID;
+        }
+        break;
+    case PROCDB_QUERY_SCAN:
+        p->scan->cursor = slot->cursor;
+        p->scan->rows = slot->page_rows;
+        p->scan->bytes = slot->page_bytes;
+        if (slot->value_d == -1) {
+            result->status = STATUS_INVALID;
+        } else {
+            p->scan->page = db->shm->cursors[slot->cursor].page;
+        }
+        break;
+    case PROCDB_QUERY_PIN:
+        if (slot->value_d == -1) {
+            result->status = STATUS_INVALID;
+        } else {
+            p->scan->epoch = slot->epoch;
+        }
+        break;
+    case PROCDB_QUERY_INSERT:
+    case PROCDB_QUERY_UPDATE:
+    case PROCDB_QUERY_DELETE:
+        result->status = slot->status;
+        break;
+    }
+    /* if the slot got reclaimed in the meantime the result might have been overwritten by the next owner of the slot */
+    return give_back(p);
+}
+
+static struct pending *find_pending(struct procdb *db, int ticket) {
+    if (ticket < 0 || ticket >= PROCDB_QUEUE_SIZE || db->pending[ticket].state == PENDING_FREE) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return &db->pending[ticket];
+}
+
+static int enqueue(struct procdb *db, const struct procdb_query *query, struct procdb_scan *scan) {
+    for (int ticket = 0; ticket < PROCDB_QUEUE_SIZE; ++ticket) {
+        struct pending *p = &db->pending[ticket];
+        if (p->state != PENDING_FREE) {
+            continue;
+        }
+        p->query = *query;
+        p->scan = scan;
+        p->sequence = db->sequence++;
+        p->state = PENDING_QUEUED;
+        if (start_queued(db) == -1) {
+            return -1;
+        }
+        return ticket;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+static int valid_query(const struct procdb_query *query) {
+    int field = query->field >= PROCDB_CPU && query->field <= PROCDB_TIME;
+    switch (query->type) {
+    case PROCDB_QUERY_FIELD:
+        return field;
+    case PROCDB_QUERY_COMMAND:
+    case PROCDB_QUERY_DELETE:
+        return TRUE;
+    case PROCDB_QUERY_AGGREGATE:
+        return field && query->aggregate >= PROCDB_MIN && query->aggregate <= PROCDB_AVG;
+    case PROCDB_QUERY_STATS:
+        return query->fields > 0 && query->fields < (1 << STATS_FIELDS) && query->aggregates > 0 && query->aggregates < (1 << STATS_AGGREGATES);
+    case PROCDB_QUERY_INSERT:
+        return query->command_length > 0 && query->command_length <= REQUEST_DATA_SIZE && query->command != NULL;
+    case PROCDB_QUERY_UPDATE:
+        if (query->field == PROCDB_COMMAND) {
+            return query->command_length > 0 && query->command_length <= REQUEST_DATA_SIZE && query->command != NULL;
+        }
+        return field;
+    case PROCDB_QUERY_WATCH:
+        return field && (query->condition == PROCDB_ABOVE || query->condition == PROCDB_BELOW);
+    case PROCDB_QUERY_DISTINCT:
+        return (query->field == PROCDB_COMMAND || query->field == PROCDB_PID) && query->windows >= 0 && query->windows <= PROCDB_DISTINCT_WINDOWS
+            && !(query->exact && query->windows != 0);
+    default:
+        return FALSE;
+    }
+}
+
+int procdb_submit(struct procdb *db, const struct procdb_query *query) {
+    if (!valid_query(query)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return enqueue(db, query, NULL);
+}
+
+int procdb_poll(struct procdb *db, int ticket, struct procdb_result *result) {
+    struct pending *p = find_pending(db, ticket);
+    if (p == NULL || start_queued(db) == -1) {
+        return -1;
+    }
+    if (p->state != PENDING_SUBMITTED) {
+        return 0;
+    }
+    uint64_t current = __atomic_load_n(&p->slot->lease, __ATOMIC_ACQUIRE);
+    if (current == response_lease(p)) {
+        int done = complete(db, p, result);
+        return done == -1 ? -1 : done == 0;
+    }
+    if (current != p->request) {
+        p->state = PENDING_FREE;
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+int procdb_wait(struct procdb *db, int ticket, struct procdb_result *result) {
+    struct pending *p = find_pending(db, ticket);
+    if (p == NULL) {
+        return -1;
+    }
+    while (TRUE) {
+        while (p->state == PENDING_QUEUED) {
+            if (start_queued(db) == -1) {
+                return -1;
+            }
+            if (p->state == PENDING_QUEUED) {
+                /* every slot is taken - the server frees the ones of dead or stalled clients */
+                if (check_server(db) == -1) {
+                    return -1;
+                }
+                struct timespec pause = {0, 100000};
+                (void) nanosleep(&pause, NULL);
+            }
+        }
+        if (wait_slot(db, p) == -1) {
+            return -1;
+        }
+        int done = complete(db, p, result);
+        if (done != 1) {
+            return done;
+        }
+    }
+}
+
+int procdb_wait_any(struct procdb *db, struct procdb_result *result) {
+    if (start_queued(db) == -1) {
+        return -1;
+    }
+    struct pending *oldest = NULL;
+    for (int ticket = 0; ticket < PROCDB_QUEUE_SIZE; ++ticket) {
+        struct pending *p = &db->pending[ticket];
+        if (p->state == PENDING_SUBMITTED && __atomic_load_n(&p->slot->lease, __ATOMIC_ACQUIRE) == response_lease(p)) {
+            int done = complete(db, p, result);
+            if (done != 1) {
+                return done == -1 ? -1 : ticket;
+            }
+        }
+        if (p->state != PENDING_FREE && (oldest == NULL || p->sequence < oldest->sequence)) {
+            oldest = p;
+        }
+    }
+    if (oldest == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    /* the server answers in order of the slots - the oldest request is the one to wait for */
+    int ticket = oldest - db->pending;
+    return procdb_wait(db, ticket, result) == -1 ? -1 : ticket;
+}
+
+int procdb_execute(struct procdb *db, const struct procdb_query *query, struct procdb_result *result) {
+    int ticket = procdb_submit(db, query);
+    if (ticket == -1) {
+        return -1;
+    }
+    return procdb_wait(db, ticket, result);
+}
+
+const char *procdb_string(struct procdb *db, size_t offset, size_t length) {
+    if (db->heap == NULL || sizeof *db->heap + offset + length > db->heap_mapped) {
+        /* the heap grew (or was never mapped) - map all of it again */
+        if (db->heap != NULL) {
+            (void) munmap((void *) db->heap, db->heap_mapped);
+            db->heap = NULL;
+        }
+        int heapfd = shm_open(SHM_STRING_HEAP, O_RDONLY, PERMISSION);
+        if (heapfd == -1) {
+            return NULL;
+        }
+        struct stat heap_stat;
+        if (fstat(heapfd, &heap_stat) == -1) {
+            (void) close(heapfd);
+            return NULL;
+        }
+        const struct string_heap *mapped = mmap(NULL, heap_stat.st_size, PROT_READ, MAP_SHARED, heapfd, 0);
+        (void) close(heapfd);
+        if (mapped == MAP_FAILED) {
+            return NULL;
+        }
+        db->heap = mapped;
+        db->heap_mapped = heap_stat.st_size;
+        if (sizeof *db->heap + offset + length > db->heap_mapped) {
+            errno = ERANGE;
+            return NULL;
+        }
+    }
+    return &db->heap->data[offset];
+}
+
+void procdb_scan_begin(struct procdb_scan *scan, int format) {
+    scan->cursor = -1;
+    scan->format = format;
+    scan->epoch = 0;
+    scan->page = NULL;
+    scan->rows = 0;
+    scan->bytes = 0;
+}
+
+int procdb_scan_next(struct procdb *db, struct procdb_scan *scan) {
+    struct procdb_query query;
+    memset(&query, 0, sizeof query);
+    query.type = PROCDB_QUERY_SCAN;
+    int ticket = enqueue(db, &query, scan);
+    if (ticket == -1) {
+        return -1;
+    }
+    struct procdb_result result;
+    if (procdb_wait(db, ticket, &result) == -1) {
+        return -1;
+    }
+    if (result.status != STATUS_OK) {
+        errno = result.status == STATUS_NO_EPOCH ? ESTALE : EBUSY;
+        return -1;
+    }
+    return scan->rows > 0;
+}
+
+uint64_t procdb_epoch(struct procdb *db) {
+    return __atomic_load_n(&db->shm->epoch, __ATOMIC_ACQUIRE);
+}
+
+int procdb_begin(struct procdb *db, uint64_t epoch, uint64_t *pinned) {
+    struct procdb_query query;
+    memset(&query, 0, sizeof query);
+    query.type = PROCDB_QUERY_PIN;
+    query.epoch = epoch;
+    /* the pinned epoch comes back like the epoch of a scan */
+    struct procdb_scan pin;
+    procdb_scan_begin(&pin, PROCDB_SCAN_BINARY);
+    int ticket = enqueue(db, &query, &pin);
+    if (ticket == -1) {
+        return -1;
+    }
+    struct procdb_result result;
+    if (procdb_wait(db, ticket, &result) == -1) {
+        return -1;
+    }
+    if (result.status != STATUS_OK) {
+        errno = result.status == STATUS_NO_EPOCH ? ESTALE : EBUSY;
+        return -1;
+    }
+    *pinned = pin.epoch;
+    return result.value;
+}
+
+void procdb_end(struct procdb *db, int pin) {
+    __atomic_store_n(&db->shm->pins[pin].owner, 0, __ATOMIC_RELEASE);
+}
+
+int procdb_watch(struct procdb *db, int pid, int field, int condition, int threshold) {
+    struct procdb_query query;
+    memset(&query, 0, sizeof query);
+    query.type = PROCDB_QUERY_WATCH;
+    query.pid = pid;
+    query.field = field;
+    query.condition = condition;
+    query.threshold = threshold;
+    struct procdb_result result;
+    if (procdb_execute(db, &query, &result) == -1) {
+        return -1;
+    }
+    if (result.status != STATUS_OK) {
+        errno = EBUSY;
+        return -1;
+    }
+    db->watch_tail[result.value] = 0;
+    return result.value;
+}
+
+int procdb_watch_next(struct procdb *db, int watch, struct procdb_event *event, int timeout_ms) {
+    struct watch *w = &db->shm->watches[watch];
+    long long deadline = monotonic_ns() + timeout_ms * 1000000LL;
+    while (TRUE) {
+        uint64_t tail = db->watch_tail[watch];
+        if (__atomic_load_n(&w->head, __ATOMIC_ACQUIRE) != tail) {
+            const struct watch_event *e = &w->events[tail & (WATCH_EVENTS - 1)];
+            event->pid = e->pid;
+            event->field = e->field;
+            event->value = e->value;
+            event->latency_ns = monotonic_ns() - e->time;
+            /* the server may reuse the event as soon as the tail has passed it */
+            db->watch_tail[watch] = tail + 1;
+            __atomic_store_n(&w->tail, tail + 1, __ATOMIC_RELEASE);
+            return 1;
+        }
+        long long left = deadline - monotonic_ns();
+        if (left <= 0) {
+            return 0;
+        }
+        /* park - if an event arrived in the meantime only the side that takes the flag back decides if a post comes */
+        __atomic_store_n(&w->client_parked, TRUE, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&w->head, __ATOMIC_SEQ_CST) != tail && __atomic_exchange_n(&w->client_parked, FALSE, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        struct timespec timeout;
+        realtime_in(left / 1000000LL < WAIT_INTERVAL_MS ? (int) (left / 1000000LL) + 1 : WAIT_INTERVAL_MS, &timeout);
+        if (sem_timedwait(&w->notify, &timeout) == 0) {
+            continue;
+        }
+        int saved = errno;
+        if (saved != EINTR && saved != ETIMEDOUT) {
+            return -1;
+        }
+        if (!__atomic_exchange_n(&w->client_parked, FALSE, __ATOMIC_SEQ_CST)) {
+            /* the server took the flag - its post has to be taken before the next park */
+            while (sem_wait(&w->notify) == -1 && errno == EINTR) {
+            }
+        }
+        if (check_server(db) == -1) {
+            return -1;
+        }
+        if (saved == EINTR) {
+            errno = EINTR;
+            return -1;
+        }
+    }
+}
+
+uint64_t procdb_watch_dropped(struct procdb *db, int watch) {
+    return __atomic_load_n(&db->shm->watches[watch].dropped, __ATOMIC_ACQUIRE);
+}
+
+void procdb_unwatch(struct procdb *db, int watch) {
+    __atomic_store_n(&db->shm->watches[watch].owner, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,180 @@
+/**
+ * @file procdb-memory.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief placement of the big memory regions of procdb-server - huge pages and NUMA nodes
+ *
+ * @date 18.10.2026
+ *
+ */
+
+/* needed for sched_setaffinity, MAP_HUGETLB and MADV_HUGEPAGE */
+#define _GNU_SOURCE
+
+#include "procdb-memory.h"
+#include "procdb.h"
+#include <sched.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief memory policy that prefers one node but falls back to others (see set_mempolicy(2))
+ */
+#define MPOL_PREFERRED (1)
+
+/**
+ * @brief how regions get backed - one of REGION_SMALL_PAGES, REGION_TRANSPARENT_HUGE_PAGES or REGION_HUGETLB
+ */
+static int policy = REGION_SMALL_PAGES;
+
+/**
+ * @brief rounds a size up to a multiple of HUGE_PAGE_SIZE
+ * @param bytes size to round
+ * @return rounded size
+ */
+static size_t huge_round(size_t bytes);
+
+/**
+ * @brief maps an anonymous region backed by huge pages
+ * @param bytes size of the region - must be a multiple of HUGE_PAGE_SIZE
+ * @return the region or NULL if it could not be mapped
+ */
+static void *huge_map(size_t bytes);
+
+
+static size_t huge_round(size_t bytes) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+static void *huge_map(size_t bytes) {
+    void *ptr;
+    if (policy == REGION_HUGETLB) {
+        ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+        /* the pool ran out - transparent huge pages are the next best thing */
+    }
+    ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    (void) madvise(ptr, bytes, MADV_HUGEPAGE);
+    return ptr;
+}
+
+int region_use_huge_pages(void) {
+    /* probe the pool with one page - if there is none MAP_HUGETLB would fail on every allocation */
+    void *probe = mmap(NULL, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (probe != MAP_FAILED) {
+        (void) munmap(probe, HUGE_PAGE_SIZE);
+        policy = REGION_HUGETLB;
+    } else {
+        policy = REGION_TRANSPARENT_HUGE_PAGES;
+    }
+    return policy;
+}
+
+int region_policy(void) {
+    return policy;
+}
+
+void *region_alloc(size_t bytes) {
+    if (policy == REGION_SMALL_PAGES) {
+        return calloc(bytes > 0 ? bytes : 1, 1);
+    }
+    return huge_map(huge_round(bytes));
+}
+
+void *region_realloc(void *ptr, size_t old_bytes, size_t new_bytes) {
+    if (policy == REGION_SMALL_PAGES) {
+        char *new_ptr = realloc(ptr, new_bytes > 0 ? new_bytes : 1);
+        if (new_ptr != NULL && new_bytes > old_bytes) {
+            memset(new_ptr + old_bytes, 0, new_bytes - old_bytes);
+        }
+        return new_ptr;
+    }
+    if (ptr != NULL && huge_round(old_bytes) == huge_round(new_bytes)) {
+        return ptr;
+    }
+    void *new_ptr = huge_map(huge_round(new_bytes));
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    if (ptr != NULL) {
+        memcpy(new_ptr, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+        region_free(ptr, old_bytes);
+    }
+    return new_ptr;
+}
+
+void region_free(void *ptr, size_t bytes) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (policy == REGION_SMALL_PAGES) {
+        free(ptr);
+        return;
+    }
+    (void) munmap(ptr, huge_round(bytes));
+}
+
+void region_advise_huge(void *addr, size_t bytes) {
+    if (policy != REGION_SMALL_PAGES) {
+        /* shared memory can not use MAP_HUGETLB - it only gets huge pages if shmem_enabled allows madvise */
+        (void) madvise(addr, bytes, MADV_HUGEPAGE);
+    }
+}
+
+int region_bind_node(int node) {
+    char path[64];
+    (void) snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *cpulist = fopen(path, "r");
+    if (cpulist == NULL) {
+        return -1;
+    }
+    /* the list looks like 0-3,8-11 */
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int first, last, cpu_count = 0;
+    char separator;
+    while (fscanf(cpulist, "%d", &first) == 1) {
+        last = first;
+        if (fscanf(cpulist, "%c", &separator) == 1 && separator == '-') {
+            if (fscanf(cpulist, "%d", &last) != 1) {
+                break;
+            }
+            (void) fscanf(cpulist, "%c", &separator);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &cpus);
+            ++cpu_count;
+        }
+    }
+    (void) fclose(cpulist);
+    if (cpu_count == 0 || sched_setaffinity(0, sizeof cpus, &cpus) == -1) {
+        return -1;
+    }
+    /* first touch would already place the pages on the node - the policy keeps it that way once the cpus of the node get busy */
+    if (node < (int) (sizeof(unsigned long) * CHAR_BIT)) {
+        unsigned long nodemask = 1UL << node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask, sizeof nodemask * CHAR_BIT) == -1 && errno != ENOSYS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int region_bind_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return sched_setaffinity(0, sizeof cpus, &cpus);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file procdb-memory.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief placement of the big memory regions of procdb-server - huge pages and NUMA nodes
+ *
+ * @details the list of processes, the compressed columns and the string heap get scanned over and over again. with huge pages one TLB entry covers 2 MB instead of 4 KB so scans and lookups miss the TLB far less often. without huge pages (the default) the regions are plain malloc memory.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_MEMORY_H
+#define PROCDB_MEMORY_H
+
+#include <stddef.h>
+
+/**
+ * @brief size of a huge page - regions backed by huge pages get rounded up to it
+ */
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+/**
+ * @brief regions are plain malloc memory
+ */
+#define REGION_SMALL_PAGES (0)
+
+/**
+ * @brief regions get mapped anonymously and marked with madvise(MADV_HUGEPAGE) for transparent huge pages
+ */
+#define REGION_TRANSPARENT_HUGE_PAGES (1)
+
+/**
+ * @brief regions get mapped with MAP_HUGETLB from the reserved huge page pool - falls back to transparent huge pages if the pool is empty
+ */
+#define REGION_HUGETLB (2)
+
+/**
+ * @brief enables huge pages for all regions allocated afterwards - explicit huge pages get used if the pool has some, otherwise transparent ones
+ * @return REGION_HUGETLB or REGION_TRANSPARENT_HUGE_PAGES
+ */
+int region_use_huge_pages(void);
+
+/**
+ * @brief returns how regions get backed
+ * @return REGION_SMALL_PAGES, REGION_TRANSPARENT_HUGE_PAGES or REGION_HUGETLB
+ */
+int region_policy(void);
+
+/**
+ * @brief allocates a zeroed region
+ * @param bytes size of the region
+ * @return the region or NULL if it could not be allocated
+ */
+void *region_alloc(size_t bytes);
+
+/**
+ * @brief changes the size of a region - the content up to the smaller size stays the same, the rest is zeroed
+ * @param ptr region or NULL
+ * @param old_bytes size the region was allocated with
+ * @param new_bytes new size of the region
+ * @return the new region or NULL if it could not be allocated - ptr stays valid then
+ */
+void *region_realloc(void *ptr, size_t old_bytes, size_t new_bytes);
+
+/**
+ * @brief frees a region
+ * @param ptr region or NULL
+ * @param bytes size the region was allocated with
+ */
+void region_free(void *ptr, size_t bytes);
+
+/**
+ * @brief asks for transparent huge pages for a shared mapping if huge pages are enabled - does nothing otherwise
+ * @param addr start of the mapping
+ * @param bytes length of the mapping
+ */
+void region_advise_huge(void *addr, size_t bytes);
+
+/**
+ * @brief binds the calling process to the cpus of a NUMA node and prefers memory of that node - must be called before the regions get filled so their pages get placed on the node
+ * @param node number of the NUMA node
+ * @return 0 on success, -1 if the node does not exist or the binding failed
+ */
+int region_bind_node(int node);
+
+/**
+ * @brief pins the calling process to one cpu - used for busy polling so the polling loop keeps its core and its cache
+ * @param cpu cpu to pin to
+ * @return 0 on success, -1 on error (errno is set)
+ */
+int region_bind_cpu(int cpu);
+
+#endif
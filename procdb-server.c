@@ -12,11 +12,32 @@
  */
 
 #include "procdb.h"
+#include "procdb-column.h"
+#include "procdb-memory.h"
+#include "procdb-index.h"
+#include "procdb-wal.h"
+#include "procdb-version.h"
+#include "procdb-hll.h"
 
  /**
- * @brief max length for a line in input-file
+ * @brief initial capacity of the data in the string heap - it grows by doubling
  */
-#define LINE_SIZE (1024)
+#define HEAP_INITIAL_CAPACITY (64*1024)
+
+ /**
+ * @brief number of size classes of the free blocks of the string heap - class c has the blocks of 2^c to 2^(c+1)-1 bytes
+ */
+#define HEAP_SIZE_CLASSES (48)
+
+ /**
+ * @brief number of free blocks of its own size class a command line tries before it takes one of a bigger class
+ */
+#define HEAP_FIT_SCAN (8)
+
+ /**
+ * @brief number of bytes that get logged before a new snapshot gets written in the background
+ */
+#define WAL_COMPACT_BYTES (64*1024*1024)
 
 
  /**
@@ -34,18 +55,6 @@ volatile sig_atomic_t quit = 0;
  */
 volatile sig_atomic_t print_db = 0;
 
-/**
- * @brief struct that represents a entry in the input file
- */
-struct process {
-    int pid;
-    int p_cpu;
-    int p_mem;
-    int p_time;
-    char *p_command;
-};
-//typedef struct process process;
-
 /**
  * @brief list of processes initially read in from the input-list
  */
@@ -62,19 +71,64 @@ int length_porccesses = 0;
 int count_porccesses = 0;
 
 /**
- * @brief semaphore for client
+ * @brief variable indicating if the processes are kept in compressed columns (option -c)
+ */
+int compressed = FALSE;
+
+/**
+ * @brief dictionary of the distinct command lines - only used in compressed mode
+ */
+struct column_dict dictionary;
+
+/**
+ * @brief compressed columns of the processes - only used in compressed mode, processes is NULL then
+ */
+struct column_store columns;
+
+/**
+ * @brief index from pid to the position in the list of processes - only used if not in compressed mode
+ */
+struct pid_index pids;
+
+/**
+ * @brief variable indicating if the input-file had a pid more than once - the index only knows the first one
+ */
+int has_duplicates = FALSE;
+
+/**
+ * @brief directory of the write-ahead log (option -w) - NULL if changes are not logged
+ */
+char *wal_dir = NULL;
+
+/**
+ * @brief the write-ahead log - only open if wal_dir is set
+ */
+struct wal wal;
+
+/**
+ * @brief pid of the process writing a snapshot in the background - -1 if none is running
+ */
+pid_t snapshot_pid = -1;
+
+/**
+ * @brief lsn the snapshot that is being written includes
+ */
+uint64_t snapshot_lsn = 0;
+
+/**
+ * @brief number of bytes logged since the last snapshot was started
  */
-sem_t *client;
+size_t logged_bytes = 0;
 
 /**
- * @brief semaphore for server
+ * @brief cpu the server busy polls the request slots on (option -P) - -1 if the server blocks on the work semaphore
  */
-sem_t *server;
+int poll_cpu = -1;
 
 /**
- * @brief semaphore for interaction_started
+ * @brief first step of the polling backoff - with only one cpu spinning is skipped because the other side can not run while we spin
  */
-sem_t *interaction_started;
+int poll_start = 0;
 
 /**
  * @brief variable indicating if semaphores & shared memory are set up 
@@ -82,187 +136,1951 @@ sem_t *interaction_started;
  int server_set_up = 0;
 
  /**
- * @brief shm is the structure for the shared memory - it needs to be locked before use with a semaphore
+ * @brief shm is the structure for the shared memory - every request slot belongs to the client whose pid is in its lease word
  */
  struct shm_struct *shm;
 
- /**
- * @brief terminate program on program error
- * @param exitcode exit code
- * @param fmt format string
- */
-static void bail_out(int exitcode, const char *fmt, ...);
+/**
+ * @brief number of events queued per watch that are not handed over yet - they get published once the writes are durable
+ */
+uint64_t watch_heads[WATCH_COUNT];
+
+/**
+ * @brief current epoch - a copy of shm->epoch only the server writes
+ */
+uint64_t current_epoch = 1;
+
+/**
+ * @brief versions of the rows before the writes of the epochs that are still pinned
+ */
+struct version_store versions;
+
+/**
+ * @brief most bytes the versions and the views used at the same time
+ */
+size_t peak_version_bytes = 0;
+
+/**
+ * @brief epoch_view is the whole list of processes as it was at an older epoch - it gets built on the first aggregate or scan page of that epoch
+ */
+struct epoch_view {
+    uint64_t epoch;
+    /* NULL if the view is free */
+    struct process *rows;
+    int count;
+    /* number of rows allocated */
+    size_t length;
+};
+
+/**
+ * @brief views of the epochs that are read - every pin and every cursor can need one, one more for reads of epochs that are not pinned
+ */
+struct epoch_view views[EPOCH_PINS + SCAN_CURSORS + 1];
+
+/**
+ * @brief sketches of the pids and command lines of the whole table - every loaded or inserted row gets added
+ */
+struct hll table_pids;
+struct hll table_commands;
+
+/**
+ * @brief TRUE if a pid or a command line might have left the table since the sketches got built - they get rebuilt on the next distinct count then
+ */
+int sketches_stale = FALSE;
+
+/**
+ * @brief distinct_window has the sketches of the pids of the rows and of the command lines that got loaded or written in one time window
+ */
+struct distinct_window {
+    /* number of the window - CLOCK_MONOTONIC time / DISTINCT_WINDOW_SECONDS */
+    long long number;
+    struct hll pids;
+    struct hll commands;
+};
+
+/**
+ * @brief ring of the sketches of the last DISTINCT_WINDOWS windows - a window gets cleared when it is used again
+ */
+struct distinct_window windows[DISTINCT_WINDOWS];
+
+/**
+ * @brief scan_state is the server side of a cursor
+ */
+struct scan_state {
+    /* epoch the cursor reads - the rows of later writes do not show up in the scan */
+    uint64_t epoch;
+    size_t count;
+    /* next row to return */
+    size_t position;
+    int format;
+    /* CLOCK_MONOTONIC time in ns until which the client has to ask for the next page */
+    long long deadline;
+};
+
+/**
+ * @brief server side of the cursors in the shared memory
+ */
+struct scan_state scans[SCAN_CURSORS];
+
+/**
+ * @brief lease_timer is the server side of the lease of a request slot
+ */
+struct lease_timer {
+    /* lease word the slot had when reclaim_slots last looked at it */
+    uint64_t lease;
+    /* CLOCK_MONOTONIC time in ns until which the client may keep that lease word */
+    long long deadline;
+};
+
+/**
+ * @brief timers of the request slots - every claim bumps the generation, so the time of a new claim starts as soon as the server sees the new lease word and no client can keep a slot without a deadline
+ */
+struct lease_timer lease_timers[SLOT_COUNT];
+
+/**
+ * @brief copy of the request that gets served - the server checks the seal of the copy and works on it, so a client that lost the slot can not change the request in the meantime
+ */
+struct request_slot request_copy;
+
+/**
+ * @brief CLOCK_MONOTONIC time in ns of the next check for slots of dead or stalled clients
+ */
+long long next_reclaim = 0;
+
+/**
+ * @brief heap is the shared string heap the command lines get published in - clients only read it
+ */
+struct string_heap *heap = NULL;
+
+/**
+ * @brief file descriptor of the string heap - it stays open so the heap can grow
+ */
+int heap_fd = -1;
+
+/**
+ * @brief heap_block is a part of the data of the string heap - a free one or a command line that got replaced or deleted
+ */
+struct heap_block {
+    size_t offset;
+    size_t length;
+    /* epoch of the write that replaced or deleted the command line - readers of older epochs can still see it */
+    uint64_t epoch;
+    /* CLOCK_MONOTONIC time in ns since when no reader of an older epoch is left - 0 as long as there is one */
+    long long unread;
+};
+
+/**
+ * @brief heap_blocks is a growing list of blocks of the string heap
+ */
+struct heap_blocks {
+    struct heap_block *blocks;
+    size_t count;
+    size_t length;
+};
+
+/**
+ * @brief free blocks of the string heap by size class - command lines of writes reuse them before the heap grows
+ */
+struct heap_blocks free_blocks[HEAP_SIZE_CLASSES];
+
+/**
+ * @brief command lines that got replaced or deleted in the order of the writes - they become free blocks once nobody can read them any more
+ */
+struct heap_blocks retired_strings;
+
+ /**
+ * @brief terminate program on program error
+ * @param exitcode exit code
+ * @param fmt format string
+ */
+static void bail_out(int exitcode, const char *fmt, ...);
+
+/**
+ * @brief free allocated resources
+ */
+static void free_resources(void);
+
+/**
+ * @brief Parse command line options
+ * @param argc The argument counter
+ * @param argv The argument vector
+ * @param options Struct where parsed arguments are stored
+ */
+static void parse_args(int argc, char **argv);
+
+/**
+ * @brief reads in the input-file and saves its content in the list of processes
+ * @param path path of the input-file
+ */
+static void read_input_file(const char *path);
+
+/**
+ * @brief stores a command line in the string heap - in compressed mode every distinct command line gets stored only once
+ * @param str command line (does not need to be null terminated)
+ * @param length length of str
+ * @return offset of the command line in the data of the string heap
+ */
+static size_t store_command(const char *str, size_t length);
+
+/**
+ * @brief compresses the list of processes into columns and prints how much memory is used per row
+ */
+static void compress_processes(void);
+
+/**
+ * @brief this funciton searches the list of processes and returns the command line
+ * @param pid for wich to look for
+ * @param epoch epoch to read
+ * @param offset gets set to the offset of the command line in the string heap
+ * @param length gets set to the length of the command line
+ * @return TRUE if the pid was found - otherwise FALSE
+ */
+static int get_command(int pid, uint64_t epoch, size_t *offset, size_t *length);
+
+/**
+ * @brief adds a row to the end of the list of processes and to the index
+ * @param p row to add
+ */
+static void append_process(const struct process *p);
+
+/**
+ * @brief searches the position of a process in the list of processes
+ * @param pid pid to look for
+ * @return position or -1 if it was not found
+ */
+static int find_process(int pid);
+
+/**
+ * @brief checks if a write request can be applied
+ * @param op WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE
+ * @param pid pid of the process
+ * @param field field of an update - 0 - cpu, 1 - mem, 2 - time, 3 - command
+ * @param command command line of an insert or update of the command
+ * @param length length of command
+ * @return STATUS_OK or the reason it can not be applied
+ */
+static int check_write(int op, int pid, int field, const char *command, size_t length);
+
+/**
+ * @brief applies a write to the list of processes - it has to be checked with check_write before
+ * @param op WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE
+ * @param pid pid of the process
+ * @param field field of an update - 0 - cpu, 1 - mem, 2 - time, 3 - command
+ * @param values cpu, mem and time of an insert - for an update only values[field] gets used
+ * @param command command line of an insert or update of the command
+ * @param length length of command
+ */
+static void apply_write(int op, int pid, int field, const int *values, const char *command, size_t length);
+
+/**
+ * @brief applies a record of the write-ahead log - used for replaying it on startup
+ * @param record record to apply
+ * @param command command line of the record
+ */
+static void replay_record(const struct wal_record *record, const char *command);
+
+/**
+ * @brief checks, logs and applies a write request and sets its status - the record is not durable yet
+ * @param slot slot of the request
+ * @return lsn of the logged record or 0 if nothing got logged
+ */
+static uint64_t handle_write(struct request_slot *slot);
+
+/**
+ * @brief answers a request of a slot - the response must not be handed over before the returned lsn is durable
+ * @param slot slot of the request
+ * @return lsn of the logged record or 0 if nothing got logged
+ */
+static uint64_t handle_request(struct request_slot *slot);
+
+/**
+ * @brief hands a free watch to the client of a slot
+ * @param slot slot of the request
+ * @return index of the watch or -1 if all are taken
+ */
+static int start_watch(struct request_slot *slot);
+
+/**
+ * @brief queues an event for every watch whose condition a changed value starts to fulfil
+ * @param pid pid of the changed process
+ * @param field changed field - 0 - cpu, 1 - mem, 2 - time
+ * @param old_value value before the change - ignored for new processes
+ * @param new_value value after the change
+ * @param existed FALSE if the process got inserted
+ */
+static void check_watches(int pid, int field, int old_value, int new_value, int existed);
+
+/**
+ * @brief hands the queued events over to the clients and wakes the parked ones
+ */
+static void publish_watches(void);
+
+/**
+ * @brief opens a cursor on a snapshot of the rows (if the cursor of the slot is -1) and fills the next page
+ * @param slot slot of the request
+ */
+static void scan_next(struct request_slot *slot);
+
+/**
+ * @brief fills the page of a cursor with the next rows
+ * @param cursor index of the cursor
+ * @param rows gets set to the number of rows in the page
+ * @param bytes gets set to the number of bytes in the page
+ */
+static void fill_page(int cursor, size_t *rows, size_t *bytes);
+
+/**
+ * @brief frees a cursor
+ * @param cursor index of the cursor
+ */
+static void close_cursor(int cursor);
+
+/**
+ * @brief hands a free pin to the client of a slot
+ * @param slot slot of the request - epoch is the epoch to pin (0 for the current one) and gets set to the pinned epoch
+ * @return index of the pin or -1 if all are taken or the epoch is not pinned (status is set then)
+ */
+static int start_pin(struct request_slot *slot);
+
+/**
+ * @brief returns the epoch a read of a slot sees
+ * @param slot slot of the request
+ * @param epoch gets set to the epoch
+ * @return TRUE if the epoch can be read - otherwise FALSE
+ */
+static int read_epoch(const struct request_slot *slot, uint64_t *epoch);
+
+/**
+ * @brief returns the newest epoch a pin or a cursor reads - a write only has to keep the version it overwrites if there is one
+ * @return the newest epoch or 0 if no epoch is read
+ */
+static uint64_t newest_read_epoch(void);
+
+/**
+ * @brief returns the list of processes as it was at an epoch - builds a view if it is not the current epoch
+ * @param epoch epoch to read - the current one or a pinned one
+ * @param count gets set to the number of rows
+ * @return the rows or NULL in compressed mode
+ */
+static const struct process *rows_as_of(uint64_t epoch, int *count);
+
+/**
+ * @brief searches a process as it was at an epoch
+ * @param pid pid to look for
+ * @param epoch epoch to read - the current one or a pinned one
+ * @param p gets set to the row
+ * @return TRUE if the pid existed at the epoch - otherwise FALSE
+ */
+static int lookup_process(int pid, uint64_t epoch, struct process *p);
+
+/**
+ * @brief checks if an epoch is read by a pin or a cursor
+ * @param epoch epoch to check
+ * @return TRUE if it is read - otherwise FALSE
+ */
+static int epoch_needed(uint64_t epoch);
+
+/**
+ * @brief frees the pins of dead clients and drops the versions and views no pin and no cursor needs anymore
+ */
+static void collect_versions(void);
+
+/**
+ * @brief remembers how much memory the versions and views use if it is the most so far
+ */
+static void update_peak_versions(void);
+
+/**
+ * @brief adds the pid and the command line of a process to the sketches of the current window
+ * @param p process that got loaded or written
+ * @param command TRUE if the command line got loaded or written too - hashing long command lines is not for free
+ * @param table TRUE if they get added to the sketches of the whole table too
+ */
+static void sketch_process(const struct process *p, int command, int table);
+
+/**
+ * @brief adds the pids or the command lines of a list of processes to a sketch
+ * @param rows list of processes - NULL in compressed mode
+ * @param count number of rows
+ * @param commands TRUE for the command lines, FALSE for the pids
+ * @param sketch sketch to add to
+ */
+static void sketch_rows(const struct process *rows, int count, int commands, struct hll *sketch);
+
+/**
+ * @brief counts the distinct pids or command lines of a list of processes exactly
+ * @param rows list of processes - NULL in compressed mode
+ * @param count number of rows
+ * @param commands TRUE for the command lines, FALSE for the pids
+ * @return the count
+ */
+static int count_exact(const struct process *rows, int count, int commands);
+
+/**
+ * @brief answers a distinct request - estimated with the sketches or counted exactly
+ * @param slot slot of the request
+ * @param epoch epoch to read - ignored for windows, they do not depend on the state of the table
+ * @return the count or -1 if the request was invalid
+ */
+static int count_distinct(const struct request_slot *slot, uint64_t epoch);
+
+/**
+ * @brief answers every slot that has a request ready and hands the responses over after one single wait for the write-ahead log
+ */
+static void serve_requests(void);
+
+/**
+ * @brief copies the request of a slot - the command line only as far as it is used
+ * @param copy gets filled with the request
+ * @param slot slot to copy from
+ * @param lease lease word of the slot in state SLOT_REQUEST
+ */
+static void copy_request(struct request_slot *copy, const struct request_slot *slot, uint64_t lease);
+
+/**
+ * @brief copies the response of a request back into its slot
+ * @param slot slot to copy to
+ * @param copy request with the response
+ */
+static void copy_response(struct request_slot *slot, const struct request_slot *copy);
+
+/**
+ * @brief checks if any slot has a request ready
+ * @return TRUE if a request is ready - otherwise FALSE
+ */
+static int requests_ready(void);
+
+/**
+ * @brief waits until a request is ready but never longer than WAIT_INTERVAL_MS - busy polls with adaptive backoff before it parks if poll_cpu is set
+ */
+static void wait_for_work(void);
+
+/**
+ * @brief frees the slots of clients that died or did not write their request or read their response in time, the watches and pins of dead clients and the cursors of clients that died or stopped scanning
+ */
+static void reclaim_slots(void);
+
+/**
+ * @brief returns the current CLOCK_MONOTONIC time
+ * @return time in ns
+ */
+static long long monotonic_ns(void);
+
+/**
+ * @brief reads the newest snapshot (or the input-file), replays the write-ahead log on top of it and opens the log
+ * @param input_path path of the input-file
+ */
+static void recover(const char *input_path);
+
+/**
+ * @brief writes the rows in the format of the input-file - used for snapshots
+ * @param file file to write to
+ * @return 0 on success, -1 on error
+ */
+static int write_snapshot_rows(FILE *file);
+
+/**
+ * @brief starts writing a snapshot in the background once enough got logged and cleans up after a finished one
+ */
+static void check_snapshot(void);
+
+/**
+ * @brief creates the shared string heap and maps it
+ */
+static void setup_string_heap(void);
+
+/**
+ * @brief grows the shared string heap until a string fits behind the used part
+ * @param length length of the string
+ * @return 0 on success, -1 if the heap could not grow (errno is set)
+ */
+static int heap_grow(size_t length);
+
+/**
+ * @brief appends a string to the shared string heap - grows the heap if needed
+ * @param str string to append (does not need to be null terminated)
+ * @param length length of str
+ * @return offset of the string in the data of the string heap
+ */
+static size_t heap_append(const char *str, size_t length);
+
+/**
+ * @brief returns the size class of a block
+ * @param length length of the block
+ * @return size class - floor(log2(length)), at most HEAP_SIZE_CLASSES - 1
+ */
+static int heap_size_class(size_t length);
+
+/**
+ * @brief searches a free block a string fits into
+ * @param length length of the string
+ * @param position gets set to the position of the block in its list
+ * @return size class of the block or -1 if no free block fits
+ */
+static int heap_find_block(size_t length, size_t *position);
+
+/**
+ * @brief stores a string in a free block of the string heap or appends it
+ * @param str string to store (does not need to be null terminated)
+ * @param length length of str
+ * @return offset of the string in the data of the string heap
+ */
+static size_t heap_alloc(const char *str, size_t length);
+
+/**
+ * @brief makes sure a string can be stored without growing the heap on the way
+ * @param length length of the string
+ * @return 0 if it fits, -1 if the heap is full (errno is set)
+ */
+static int heap_reserve(size_t length);
+
+/**
+ * @brief adds a block to a list of blocks
+ * @param list list to add to
+ * @param block block to add
+ */
+static void heap_blocks_push(struct heap_blocks *list, const struct heap_block *block);
+
+/**
+ * @brief gives a part of the string heap back to the free blocks
+ * @param offset offset of the part
+ * @param length length of the part
+ */
+static void heap_free(size_t offset, size_t length);
+
+/**
+ * @brief compares two blocks by offset - used for qsort
+ * @param a first block
+ * @param b second block
+ * @return <0, 0 or >0
+ */
+static int compare_offset(const void *a, const void *b);
+
+/**
+ * @brief merges neighbouring free blocks of the string heap - a free block at the end of the used part gets handed back to heap->used
+ */
+static void heap_coalesce(void);
+
+/**
+ * @brief remembers the command line of a row that a write replaces or deletes - it gets freed once nobody can read it any more
+ * @param p row before the write
+ */
+static void retire_string(const struct process *p);
+
+/**
+ * @brief frees the retired command lines no reader can see any more - after HEAP_GRACE_MS for clients that still read them in place
+ * @param horizon oldest epoch that is still read
+ */
+static void reclaim_strings(uint64_t horizon);
+
+/**
+ * @brief Signal handler for SIGINT & SIGTERM which should shut down the server
+ * @param sig Signal number catched
+ */
+static void signal_quit_handler(int sig);
+
+/**
+ * @brief Signal handler for SIGUSR1 which should print all data in the database
+ * @param sig Signal number catched
+ */
+static void signal_print_db_handler(int sig);
+
+/**
+ * @brief this funciton calculates and returns the result of the calculation of min/max/sum/avg over all processes
+ * @param rows list of processes to aggregate - ignored in compressed mode
+ * @param count number of rows
+ * @param command 0 - min, 1 - max, 2 - sum, 3 - avg
+ * @param field 0 - cpu, 1 - mem, 2 - time
+ * @param result gets set to the result - -1 if the request is invalid
+ * @return STATUS_OK or STATUS_INVALID if the command or the field does not exist
+ */
+static int calculate_min_max_sum_avg(const struct process *rows, int count, int command, int field, int *result);
+
+/**
+ * @brief this funciton calculates several aggregates over several fields in one pass over all processes
+ * @param rows list of processes to aggregate - ignored in compressed mode
+ * @param count number of rows
+ * @param aggregates bitmask of the aggregates - 1 - min, 2 - max, 4 - sum, 8 - avg
+ * @param fields bitmask of the fields - 1 - cpu, 2 - mem, 4 - time
+ * @param results gets filled with the results indexed by field and aggregate - everything that was not asked for is 0
+ * @return STATUS_OK or STATUS_INVALID if a bitmask is empty or has bits of aggregates or fields that do not exist
+ */
+static int calculate_stats(const struct process *rows, int count, int aggregates, int fields, long long results[STATS_FIELDS][STATS_AGGREGATES]);
+
+/**
+ * @brief this funciton searches the list of processes and returns the value
+ * @param pid for wich to look for
+ * @param field 0 - cpu, 1 - mem, 2 - time
+ * @param epoch epoch to read
+ * @param value gets set to the value if it was found - otherwise to -1
+ * @return STATUS_OK or STATUS_INVALID if the field does not exist
+ */
+static int get_cpu_mem_time(int pid, int field, uint64_t epoch, int *value);
+
+
+static void bail_out(int exitcode, const char *fmt, ...) {
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+
+    free_resources();
+    exit(exitcode);
+}
+
+static void free_resources(void) {
+    printf("freeing resources\n");
+    if (wal_dir != NULL) {
+        wal_close(&wal);
+    }
+    if (pids.rows != NULL) {
+        pid_index_free(&pids);
+    }
+    if (processes != NULL) {
+        region_free(processes, length_porccesses*sizeof(struct process));
+    }
+    if (compressed) {
+        column_free(&columns);
+        column_dict_free(&dictionary);
+    }
+    if (heap != NULL) {
+        if (munmap(heap, sizeof *heap + heap->capacity) == -1) {
+            printf("could not munmap string heap");
+        }
+    }
+    if (heap_fd != -1) {
+        if (close(heap_fd) == -1) {
+            printf("could not close string heap file descriptor");
+        }
+        if (shm_unlink(SHM_STRING_HEAP) == -1) {
+            printf("could not unlink string heap");
+        }
+    }
+    for (int i = 0; i < COUNT_OF(views); ++i) {
+        if (views[i].rows != NULL) {
+            region_free(views[i].rows, views[i].length * sizeof(struct process));
+        }
+    }
+    version_free(&versions);
+    for (int c = 0; c < HEAP_SIZE_CLASSES; ++c) {
+        free(free_blocks[c].blocks);
+    }
+    free(retired_strings.blocks);
+    if (server_set_up) {
+        if (sem_destroy(&shm->work) == -1) {
+            printf("could not destroy work semaphore");
+        }
+        for (int i = 0; i < SLOT_COUNT; ++i) {
+            if (sem_destroy(&shm->slots[i].response) == -1) {
+                printf("could not destroy response semaphore");
+            }
+        }
+        for (int i = 0; i < WATCH_COUNT; ++i) {
+            if (sem_destroy(&shm->watches[i].notify) == -1) {
+                printf("could not destroy notify semaphore");
+            }
+        }
+        /* unmap shared memory */
+        if (munmap(shm, sizeof *shm) == -1) {
+            printf("could not munmap shared memory");
+        }
+        /* remove shared memory */
+        if (shm_unlink(SHM_SERVER) == -1) {
+            printf("could not unlink shared memory");
+        }
+    }
+}
+
+static void parse_args(int argc, char **argv) {
+    if(argc > 0) {
+        progname = argv[0];
+    }
+    int c;
+    int huge_pages = FALSE;
+    int numa_node = -1;
+    char *endptr;
+    while ((c = getopt(argc, argv, "cHN:P:w:")) != -1) {
+        switch (c) {
+        case 'c':
+            compressed = TRUE;
+            break;
+        case 'H':
+            huge_pages = TRUE;
+            break;
+        case 'N':
+            endptr = NULL;
+            numa_node = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0' || numa_node < 0) {
+                bail_out(EXIT_FAILURE, "invalid NUMA node - usage: procdb-server [-c] [-H] [-N node] [-P cpu] [-w wal-directory] input-file");
+            }
+            break;
+        case 'P':
+            endptr = NULL;
+            poll_cpu = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0' || poll_cpu < 0) {
+                bail_out(EXIT_FAILURE, "invalid cpu - usage: procdb-server [-c] [-H] [-N node] [-P cpu] [-w wal-directory] input-file");
+            }
+            break;
+        case 'w':
+            wal_dir = optarg;
+            break;
+        default:
+            bail_out(EXIT_FAILURE, "invalid option - usage: procdb-server [-c] [-H] [-N node] [-P cpu] [-w wal-directory] input-file");
+        }
+    }
+    if (argc - optind != 1) {
+        bail_out(EXIT_FAILURE, "needs input-file - usage: procdb-server [-c] [-H] [-N node] [-P cpu] [-w wal-directory] input-file");
+    }
+    if (compressed && wal_dir != NULL) {
+        bail_out(EXIT_FAILURE, "compressed columns are read-only - -c and -w can not be combined");
+    }
+    /* placement has to be decided before the input-file gets read - pages end up where they get touched first */
+    if (numa_node != -1) {
+        if (region_bind_node(numa_node) == -1) {
+            bail_out(EXIT_FAILURE, "could not bind to NUMA node %d", numa_node);
+        }
+        printf("bound to NUMA node %d\n", numa_node);
+    }
+    if (poll_cpu != -1 && sysconf(_SC_NPROCESSORS_ONLN) == 1) {
+        poll_start = POLL_SPINS + POLL_PAUSES;
+    }
+    if (poll_cpu != -1) {
+        /* after the NUMA binding - the polling core should be one of the node */
+        if (region_bind_cpu(poll_cpu) == -1) {
+            bail_out(EXIT_FAILURE, "could not pin to cpu %d", poll_cpu);
+        }
+        printf("busy polling on cpu %d\n", poll_cpu);
+    }
+    if (huge_pages) {
+        if (region_use_huge_pages() == REGION_HUGETLB) {
+            printf("using explicit huge pages (MAP_HUGETLB)\n");
+        } else {
+            printf("no reserved huge pages - using transparent huge pages (madvise)\n");
+        }
+        region_advise_huge(shm, sizeof *shm);
+        region_advise_huge(heap, sizeof *heap + heap->capacity);
+    }
+    if (compressed && column_dict_init(&dictionary) == -1) {
+        bail_out(EXIT_FAILURE, "could not allocate command dictionary");
+    }
+    if (!compressed && pid_index_init(&pids) == -1) {
+        bail_out(EXIT_FAILURE, "could not allocate pid index");
+    }
+    /* versions of the rows - allocated like the rows, so only once huge pages are decided. the writes of the log replay already count epochs */
+    if (version_init(&versions, current_epoch) == -1) {
+        bail_out(EXIT_FAILURE, "could not set up versions");
+    }
+    shm->epoch = current_epoch;
+    if (wal_dir != NULL) {
+        recover(argv[optind]);
+    } else {
+        read_input_file(argv[optind]);
+    }
+    if (compressed) {
+        compress_processes();
+    }
+}
+
+static void read_input_file(const char *path) {
+    /* open input-file and read line by line - save content */
+    FILE *input_file;
+    input_file = fopen(path, "r");
+    if (input_file == NULL) {
+        bail_out(EXIT_FAILURE, "could not open file - enter valid file - usage: procdb-server [-c] [-H] [-N node] [-P cpu] [-w wal-directory] input-file");
+    }
+    /* reserve list of processes to save stuff from input-file in */
+    processes = region_alloc(sizeof(struct process)*5);
+    if (processes == NULL) {
+        bail_out(EXIT_FAILURE, "could not allocate list of processes");
+    }
+    length_porccesses = 5;
+    /* lines get read with getline so command lines of any length are possible */
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t line_length;
+    while ((line_length = getline(&line, &line_size, input_file)) != -1) {
+        struct process p;
+
+        if (line_length > 0 && line[line_length-1] == '\n') {
+            line[--line_length] = '\0';
+        }
+        if (line_length == 0) {
+            continue;
+        }
+
+        char *s = strtok(line,",");
+        int cnt = 0; // 0 - pid, 1 - cpu, 2 - mem, 3 - time, 4 - command
+        int i;
+        char *endptr = NULL;
+        while (s != NULL) {
+            if (cnt > 4) {
+                bail_out(EXIT_FAILURE, "too many arguments in input-file");
+            }
+            if (cnt != 4) {
+                endptr = NULL;
+                i = strtol(s, &endptr, 10);
+                if (endptr == s || strcmp("", endptr) != 0  || ((i == LONG_MAX || i == LONG_MIN) && errno == ERANGE)) {
+                    bail_out(EXIT_FAILURE, "invalid int in input-file");
+                }
+            } 
+            switch (cnt) {
+            case 0:
+                p.pid = i;
+                break;
+            case 1:
+                p.p_cpu = i;
+                break;
+            case 2:
+                p.p_mem = i;
+                break;
+            case 3:
+                p.p_time = i;
+                break;
+            case 4:
+                p.p_command_length = strlen(s);
+                p.p_command_offset = store_command(s, p.p_command_length);
+                break;
+            default:
+                bail_out(EXIT_FAILURE, "too many arguments in one line in input-file");
+            }
+            s = strtok(NULL,",");
+            ++ cnt;
+        }
+        if (cnt != 5) {
+            bail_out(EXIT_FAILURE, "too few arguments in one line in input-file");
+        }
+
+        append_process(&p);
+    }
+    free(line);
+    if (feof(input_file) == 0) {
+        bail_out(EXIT_FAILURE, "could not properly read input-file");
+    }
+    if (fclose(input_file) != 0) {
+        bail_out(EXIT_FAILURE, "could not properly close input-file after read");
+    }
+}
+
+static void append_process(const struct process *p) {
+    if (count_porccesses+1 >= length_porccesses) {
+        /* grow by doubling so big input-files do not get copied over and over again */
+        struct process *grown = region_realloc(processes, length_porccesses*sizeof(struct process), 2*length_porccesses*sizeof(struct process));
+        if (grown == NULL) {
+            bail_out(EXIT_FAILURE, "could not grow list of processes");
+        }
+        processes = grown;
+        length_porccesses *= 2;
+    }
+    if (!compressed) {
+        /* the index keeps the first row of a pid - that is the one every lookup returns */
+        if (pid_index_find(&pids, p->pid) != -1) {
+            has_duplicates = TRUE;
+        } else if (pid_index_put(&pids, p->pid, count_porccesses) == -1) {
+            bail_out(EXIT_FAILURE, "could not grow pid index");
+        }
+    }
+    processes[count_porccesses] = *p;
+    count_porccesses ++;
+    sketch_process(p, TRUE, TRUE);
+}
+
+static int find_process(int pid) {
+    return pid_index_find(&pids, pid);
+}
+
+static int check_write(int op, int pid, int field, const char *command, size_t length) {
+    if (compressed) {
+        return STATUS_READ_ONLY;
+    }
+    if (pid < 0) {
+        return STATUS_INVALID;
+    }
+    /* command lines must not break the format of the snapshots */
+    if ((op == WRITE_INSERT || (op == WRITE_UPDATE && field == 3))
+        && (length == 0 || memchr(command, ',', length) != NULL || memchr(command, '\n', length) != NULL)) {
+        return STATUS_INVALID;
+    }
+    int status;
+    switch (op) {
+    case WRITE_INSERT:
+        status = find_process(pid) == -1 ? STATUS_OK : STATUS_EXISTS;
+        break;
+    case WRITE_UPDATE:
+        if (field < 0 || field > 3) {
+            return STATUS_INVALID;
+        }
+        status = find_process(pid) != -1 ? STATUS_OK : STATUS_NOT_FOUND;
+        break;
+    case WRITE_DELETE:
+        return find_process(pid) != -1 ? STATUS_OK : STATUS_NOT_FOUND;
+    default:
+        return STATUS_INVALID;
+    }
+    /* a command line that does not fit into the string heap any more gets refused before anything gets logged or changed */
+    if (status == STATUS_OK && (op == WRITE_INSERT || field == 3) && heap_reserve(length) == -1) {
+        printf("string heap is full - refused a command line of %zu bytes\n", length);
+        errno = 0;
+        return STATUS_INVALID;
+    }
+    return status;
+}
+
+static void apply_write(int op, int pid, int field, const int *values, const char *command, size_t length) {
+    struct process p;
+    int row = find_process(pid);
+    /* readers of an older epoch see the row as it was before this write */
+    uint64_t newest = newest_read_epoch();
+    if (newest == 0) {
+        if (version_collect(&versions, current_epoch + 1) == -1) {
+            bail_out(EXIT_FAILURE, "could not drop versions");
+        }
+    } else if (version_add(&versions, current_epoch + 1, op, op == WRITE_INSERT ? count_porccesses : row, pid, row == -1 ? NULL : &processes[row], newest) == -1) {
+        bail_out(EXIT_FAILURE, "could not grow versions");
+    } else {
+        update_peak_versions();
+    }
+    switch (op) {
+    case WRITE_INSERT:
+        p.pid = pid;
+        p.p_cpu = values[0];
+        p.p_mem = values[1];
+        p.p_time = values[2];
+        p.p_command_length = length;
+        p.p_command_offset = store_command(command, length);
+        append_process(&p);
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            check_watches(pid, f, 0, values[f], FALSE);
+        }
+        break;
+    case WRITE_UPDATE:
+        if (field == 0) {
+            check_watches(pid, field, processes[row].p_cpu, values[0], TRUE);
+            processes[row].p_cpu = values[0];
+        } else if (field == 1) {
+            check_watches(pid, field, processes[row].p_mem, values[1], TRUE);
+            processes[row].p_mem = values[1];
+        } else if (field == 2) {
+            check_watches(pid, field, processes[row].p_time, values[2], TRUE);
+            processes[row].p_time = values[2];
+        } else {
+            /* the old command line stays where it is until no reader can see it any more */
+            retire_string(&processes[row]);
+            processes[row].p_command_offset = store_command(command, length);
+            processes[row].p_command_length = length;
+            /* the old command line might have been the last one of its kind */
+            sketches_stale = TRUE;
+        }
+        sketch_process(&processes[row], field == 3, FALSE);
+        break;
+    case WRITE_DELETE:
+        /* sketches can not forget a value - they get rebuilt */
+        sketches_stale = TRUE;
+        retire_string(&processes[row]);
+        /* the last row takes the place of the deleted one */
+        pid_index_remove(&pids, pid);
+        --count_porccesses;
+        if (row != count_porccesses) {
+            processes[row] = processes[count_porccesses];
+            if (pid_index_find(&pids, processes[row].pid) == count_porccesses) {
+                (void) pid_index_put(&pids, processes[row].pid, row);
+            }
+        }
+        if (has_duplicates) {
+            /* another row with the same pid becomes the one lookups return */
+            for (int i = 0; i < count_porccesses; ++i) {
+                if (processes[i].pid == pid) {
+                    if (pid_index_put(&pids, pid, i) == -1) {
+                        bail_out(EXIT_FAILURE, "could not grow pid index");
+                    }
+                    break;
+                }
+            }
+        }
+        break;
+    }
+    ++current_epoch;
+    __atomic_store_n(&shm->epoch, current_epoch, __ATOMIC_RELEASE);
+}
+
+static void replay_record(const struct wal_record *record, const char *command) {
+    int values[STATS_FIELDS] = {record->values[0], record->values[1], record->values[2]};
+    if (check_write(record->op, record->pid, record->field, command, record->length) != STATUS_OK) {
+        bail_out(EXIT_FAILURE, "write-ahead log record %llu does not fit the snapshot", (unsigned long long) record->lsn);
+    }
+    apply_write(record->op, record->pid, record->field, values, command, record->length);
+}
+
+static uint64_t handle_write(struct request_slot *slot) {
+    int op = slot->write_op;
+    int pid = slot->pid;
+    int field = slot->info;
+    size_t length = slot->request_length > REQUEST_DATA_SIZE ? REQUEST_DATA_SIZE : slot->request_length;
+    const char *command = slot->request_data;
+    slot->status = check_write(op, pid, field, command, length);
+    if (slot->status != STATUS_OK) {
+        return 0;
+    }
+    uint64_t lsn = 0;
+    if (wal_dir != NULL) {
+        /* log before applying - the client only gets its answer once the record is durable (see serve_requests) */
+        struct wal_record record;
+        memset(&record, 0, sizeof record);
+        record.op = op;
+        record.pid = pid;
+        record.field = field;
+        for (int f = 0; f < STATS_FIELDS; ++f) {
+            record.values[f] = slot->write_values[f];
+        }
+        record.length = (op == WRITE_INSERT || (op == WRITE_UPDATE && field == 3)) ? length : 0;
+        lsn = wal_append(&wal, &record, command);
+        if (lsn == 0) {
+            bail_out(EXIT_FAILURE, "could not append to write-ahead log");
+        }
+        logged_bytes += sizeof record + record.length;
+    }
+    apply_write(op, pid, field, slot->write_values, command, length);
+    return lsn;
+}
+
+static uint64_t handle_request(struct request_slot *slot) {
+    if (slot->write_op != 0) {
+        return handle_write(slot);
+    }
+    slot->status = STATUS_OK;
+    if (slot->pid == -4) {
+        slot->value_d = start_watch(slot);
+        return 0;
+    }
+    if (slot->pid == -6) {
+        slot->value_d = start_pin(slot);
+        return 0;
+    }
+    uint64_t epoch;
+    if (!read_epoch(slot, &epoch)) {
+        slot->status = STATUS_NO_EPOCH;
+        slot->value_d = -1;
+        return 0;
+    }
+    int count;
+    if (slot->pid == -5) {
+        scan_next(slot);
+    } else if (slot->pid == -7) {
+        slot->value_d = count_distinct(slot, epoch);
+    } else if (slot->pid == -3) {
+        const struct process *rows = rows_as_of(epoch, &count);
+        slot->status = calculate_stats(rows, count, slot->stats_aggregates, slot->stats_fields, slot->stats);
+    } else if (slot->pid_cmd != -1) {
+        const struct process *rows = rows_as_of(epoch, &count);
+        slot->status = calculate_min_max_sum_avg(rows, count, slot->pid_cmd, slot->info, &slot->value_d);
+    } else if (slot->info == 3) {
+        /* only offset and length get returned - the client reads the command line in the string heap */
+        slot->value_d = get_command(slot->pid, epoch, &slot->value_offset, &slot->value_length) ? 0 : -1;
+    } else {
+        slot->status = get_cpu_mem_time(slot->pid, slot->info, epoch, &slot->value_d);
+    }
+    return 0;
+}
+
+static int start_watch(struct request_slot *slot) {
+    if (slot->info < 0 || slot->info >= STATS_FIELDS || (slot->watch_condition != WATCH_ABOVE && slot->watch_condition != WATCH_BELOW)) {
+        return -1;
+    }
+    for (int i = 0; i < WATCH_COUNT; ++i) {
+        struct watch *watch = &shm->watches[i];
+        if (__atomic_load_n(&watch->owner, __ATOMIC_ACQUIRE) != 0) {
+            continue;
+        }
+        /* a post nobody waited for must not wake up the new owner */
+        while (sem_trywait(&watch->notify) == 0) {
+        }
+        watch->pid = slot->watch_pid;
+        watch->field = slot->info;
+        watch->condition = slot->watch_condition;
+        watch->threshold = slot->watch_threshold;
+        watch->client_parked = FALSE;
+        watch->head = 0;
+        watch->tail = 0;
+        watch->dropped = 0;
+        watch_heads[i] = 0;
+        __atomic_store_n(&watch->owner, LEASE_PID(__atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE)), __ATOMIC_RELEASE);
+        return i;
+    }
+    return -1;
+}
+
+static void check_watches(int pid, int field, int old_value, int new_value, int existed) {
+    long long now = 0;
+    for (int i = 0; i < WATCH_COUNT; ++i) {
+        struct watch *watch = &shm->watches[i];
+        if (__atomic_load_n(&watch->owner, __ATOMIC_ACQUIRE) == 0 || watch->field != field || (watch->pid != -1 && watch->pid != pid)) {
+            continue;
+        }
+        int now_true = watch->condition == WATCH_ABOVE ? new_value > watch->threshold : new_value < watch->threshold;
+        int was_true = watch->condition == WATCH_ABOVE ? old_value > watch->threshold : old_value < watch->threshold;
+        /* edge triggered - only rows that start to fulfil the condition get queued */
+        if (!now_true || (existed && was_true)) {
+            continue;
+        }
+        if (watch_heads[i] - __atomic_load_n(&watch->tail, __ATOMIC_ACQUIRE) >= WATCH_EVENTS) {
+            ++watch->dropped;
+            continue;
+        }
+        if (now == 0) {
+            now = monotonic_ns();
+        }
+        struct watch_event *event = &watch->events[watch_heads[i] & (WATCH_EVENTS - 1)];
+        event->pid = pid;
+        event->field = field;
+        event->value = new_value;
+        event->time = now;
+        ++watch_heads[i];
+    }
+}
+
+static void publish_watches(void) {
+    for (int i = 0; i < WATCH_COUNT; ++i) {
+        struct watch *watch = &shm->watches[i];
+        if (watch_heads[i] == watch->head) {
+            continue;
+        }
+        __atomic_store_n(&watch->head, watch_heads[i], __ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&watch->client_parked, FALSE, __ATOMIC_SEQ_CST) && sem_post(&watch->notify) == -1) {
+            bail_out(errno, "sem_post failed");
+        }
+    }
+}
+
+static void scan_next(struct request_slot *slot) {
+    pid_t client = LEASE_PID(__atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE));
+    int cursor = slot->cursor;
+    slot->page_rows = 0;
+    slot->page_bytes = 0;
+    slot->value_d = -1;
+    if (cursor == -1) {
+        uint64_t epoch;
+        if ((slot->format != SCAN_BINARY && slot->format != SCAN_CSV) || !read_epoch(slot, &epoch)) {
+            return;
+        }
+        for (int i = 0; i < SCAN_CURSORS && cursor == -1; ++i) {
+            if (shm->cursors[i].owner == 0) {
+                cursor = i;
+            }
+        }
+        if (cursor == -1) {
+            return;
+        }
+        struct scan_state *scan = &scans[cursor];
+        int count;
+        /* the cursor reads its epoch - the rows only get copied if a write comes before the scan is done */
+        (void) rows_as_of(epoch, &count);
+        scan->epoch = epoch;
+        scan->count = count;
+        scan->position = 0;
+        scan->format = slot->format;
+        __atomic_store_n(&shm->cursors[cursor].owner, client, __ATOMIC_RELEASE);
+    } else if (cursor < 0 || cursor >= SCAN_CURSORS || shm->cursors[cursor].owner != client) {
+        return;
+    }
+    fill_page(cursor, &slot->page_rows, &slot->page_bytes);
+    slot->cursor = cursor;
+    slot->value_d = 0;
+    if (slot->page_rows == 0) {
+        close_cursor(cursor);
+    } else {
+        scans[cursor].deadline = monotonic_ns() + LEASE_TIMEOUT_MS * 1000000LL;
+    }
+}
+
+static void fill_page(int cursor, size_t *rows, size_t *bytes) {
+    struct scan_state *scan = &scans[cursor];
+    char *page = shm->cursors[cursor].page;
+    size_t remaining = scan->count - scan->position;
+    int count_at_epoch;
+    const struct process *snapshot = rows_as_of(scan->epoch, &count_at_epoch);
+    /* the compressed layout decodes the pids of a block once for all its rows of the page */
+    struct column_iterator iterator;
+    column_iterator_init(&iterator, &columns, scan->position);
+    if (scan->format == SCAN_BINARY) {
+        size_t count = SCAN_PAGE_SIZE / sizeof(struct process);
+        if (count > remaining) {
+            count = remaining;
+        }
+        if (snapshot != NULL) {
+            (void) memcpy(page, &snapshot[scan->position], count * sizeof(struct process));
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                (void) column_iterator_next(&iterator, &((struct process *) page)[i]);
+            }
+        }
+        scan->position += count;
+        *rows = count;
+        *bytes = count * sizeof(struct process);
+        return;
+    }
+    size_t used = 0;
+    size_t count = 0;
+    for (; count < remaining; ++count) {
+        struct process p;
+        if (snapshot != NULL) {
+            p = snapshot[scan->position + count];
+        } else {
+            (void) column_iterator_next(&iterator, &p);
+        }
+        int length = snprintf(page + used, SCAN_PAGE_SIZE - used, "%d,%d,%d,%d,%.*s\n", p.pid, p.p_cpu, p.p_mem, p.p_time,
+            (int) p.p_command_length, &heap->data[p.p_command_offset]);
+        if (length < 0 || (size_t) length >= SCAN_PAGE_SIZE - used) {
+            if (count == 0) {
+                /* a row longer than a page gets cut - otherwise the scan could not go on */
+                used = SCAN_PAGE_SIZE - 1;
+                page[used - 1] = '\n';
+                ++count;
+            }
+            break;
+        }
+        used += length;
+    }
+    scan->position += count;
+    *rows = count;
+    *bytes = used;
+}
+
+static void close_cursor(int cursor) {
+    /* the view of its epoch gets dropped by collect_versions once nobody else reads it */
+    __atomic_store_n(&shm->cursors[cursor].owner, 0, __ATOMIC_RELEASE);
+}
+
+static int start_pin(struct request_slot *slot) {
+    uint64_t epoch;
+    if (!read_epoch(slot, &epoch)) {
+        slot->status = STATUS_NO_EPOCH;
+        return -1;
+    }
+    for (int i = 0; i < EPOCH_PINS; ++i) {
+        struct epoch_pin *pin = &shm->pins[i];
+        if (__atomic_load_n(&pin->owner, __ATOMIC_ACQUIRE) != 0) {
+            continue;
+        }
+        pin->epoch = epoch;
+        slot->epoch = epoch;
+        __atomic_store_n(&pin->owner, LEASE_PID(__atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE)), __ATOMIC_RELEASE);
+        return i;
+    }
+    return -1;
+}
+
+static int read_epoch(const struct request_slot *slot, uint64_t *epoch) {
+    /* the versions only cover the epochs that were read when the writes happened */
+    *epoch = slot->epoch == 0 ? current_epoch : slot->epoch;
+    return *epoch == current_epoch || (*epoch >= versions.oldest && epoch_needed(*epoch));
+}
+
+static uint64_t newest_read_epoch(void) {
+    uint64_t newest = 0;
+    for (int i = 0; i < EPOCH_PINS; ++i) {
+        if (__atomic_load_n(&shm->pins[i].owner, __ATOMIC_ACQUIRE) != 0 && shm->pins[i].epoch > newest) {
+            newest = shm->pins[i].epoch;
+        }
+    }
+    for (int i = 0; i < SCAN_CURSORS; ++i) {
+        if (shm->cursors[i].owner != 0 && scans[i].epoch > newest) {
+            newest = scans[i].epoch;
+        }
+    }
+    return newest;
+}
+
+static const struct process *rows_as_of(uint64_t epoch, int *count) {
+    if (compressed || epoch == current_epoch) {
+        *count = count_porccesses;
+        return processes;
+    }
+    struct epoch_view *free_view = NULL;
+    for (int i = 0; i < COUNT_OF(views); ++i) {
+        if (views[i].rows == NULL) {
+            free_view = free_view == NULL ? &views[i] : free_view;
+        } else if (views[i].epoch == epoch) {
+            *count = views[i].count;
+            return views[i].rows;
+        }
+    }
+    if (free_view == NULL) {
+        /* only reads of epochs that are not pinned fill the last view - one of them makes room */
+        for (int i = 0; i < COUNT_OF(views) && free_view == NULL; ++i) {
+            if (!epoch_needed(views[i].epoch)) {
+                region_free(views[i].rows, views[i].length * sizeof(struct process));
+                views[i].rows = NULL;
+                free_view = &views[i];
+            }
+        }
+    }
+    free_view->epoch = epoch;
+    free_view->count = version_build(&versions, epoch, processes, count_porccesses, &free_view->rows, &free_view->length);
+    if (free_view->count == -1) {
+        free_view->rows = NULL;
+        bail_out(EXIT_FAILURE, "could not build the rows of epoch %llu", (unsigned long long) epoch);
+    }
+    update_peak_versions();
+    *count = free_view->count;
+    return free_view->rows;
+}
+
+static int lookup_process(int pid, uint64_t epoch, struct process *p) {
+    if (compressed) {
+        return column_lookup(&columns, pid, p);
+    }
+    int i = find_process(pid);
+    if (epoch != current_epoch) {
+        return version_lookup(&versions, i == -1 ? NULL : &processes[i], pid, epoch, p);
+    }
+    if (i == -1) {
+        return FALSE;
+    }
+    *p = processes[i];
+    return TRUE;
+}
+
+static int epoch_needed(uint64_t epoch) {
+    for (int i = 0; i < EPOCH_PINS; ++i) {
+        if (__atomic_load_n(&shm->pins[i].owner, __ATOMIC_ACQUIRE) != 0 && shm->pins[i].epoch == epoch) {
+            return TRUE;
+        }
+    }
+    for (int i = 0; i < SCAN_CURSORS; ++i) {
+        if (shm->cursors[i].owner != 0 && scans[i].epoch == epoch) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void collect_versions(void) {
+    uint64_t horizon = current_epoch;
+    for (int i = 0; i < EPOCH_PINS; ++i) {
+        pid_t owner = __atomic_load_n(&shm->pins[i].owner, __ATOMIC_ACQUIRE);
+        if (owner == 0) {
+            continue;
+        }
+        if (kill(owner, 0) == -1 && errno == ESRCH) {
+            __atomic_store_n(&shm->pins[i].owner, 0, __ATOMIC_RELEASE);
+            printf("reclaimed pin %d of dead client %d\n", i, (int) owner);
+        } else if (shm->pins[i].epoch < horizon) {
+            horizon = shm->pins[i].epoch;
+        }
+    }
+    for (int i = 0; i < SCAN_CURSORS; ++i) {
+        if (shm->cursors[i].owner != 0 && scans[i].epoch < horizon) {
+            horizon = scans[i].epoch;
+        }
+    }
+    if (version_collect(&versions, horizon) == -1) {
+        bail_out(EXIT_FAILURE, "could not drop versions");
+    }
+    for (int i = 0; i < COUNT_OF(views); ++i) {
+        if (views[i].rows != NULL && !epoch_needed(views[i].epoch)) {
+            region_free(views[i].rows, views[i].length * sizeof(struct process));
+            views[i].rows = NULL;
+        }
+    }
+    reclaim_strings(horizon);
+}
+
+static void sketch_process(const struct process *p, int command, int table) {
+    uint64_t pid = hll_hash_int(p->pid);
+    long long number = monotonic_ns() / (DISTINCT_WINDOW_SECONDS * 1000000000LL);
+    struct distinct_window *window = &windows[number % DISTINCT_WINDOWS];
+    if (window->number != number) {
+        /* the window was used DISTINCT_WINDOWS windows ago (or never) */
+        window->number = number;
+        hll_clear(&window->pids);
+        hll_clear(&window->commands);
+    }
+    hll_add(&window->pids, pid);
+    if (table) {
+        hll_add(&table_pids, pid);
+    }
+    if (command) {
+        uint64_t hash = hll_hash(&heap->data[p->p_command_offset], p->p_command_length);
+        hll_add(&window->commands, hash);
+        if (table) {
+            hll_add(&table_commands, hash);
+        }
+    }
+}
+
+static void sketch_rows(const struct process *rows, int count, int commands, struct hll *sketch) {
+    struct column_iterator iterator;
+    column_iterator_init(&iterator, &columns, 0);
+    for (int i = 0; i < count; ++i) {
+        struct process p;
+        if (rows != NULL) {
+            p = rows[i];
+        } else {
+            (void) column_iterator_next(&iterator, &p);
+        }
+        hll_add(sketch, commands ? hll_hash(&heap->data[p.p_command_offset], p.p_command_length) : hll_hash_int(p.pid));
+    }
+}
+
+static int count_exact(const struct process *rows, int count, int commands) {
+    struct pid_index seen_pids;
+    struct column_dict seen_commands;
+    if (commands ? column_dict_init(&seen_commands) == -1 : pid_index_init(&seen_pids) == -1) {
+        bail_out(EXIT_FAILURE, "could not allocate set for exact distinct count");
+    }
+    struct column_iterator iterator;
+    column_iterator_init(&iterator, &columns, 0);
+    for (int i = 0; i < count; ++i) {
+        struct process p;
+        if (rows != NULL) {
+            p = rows[i];
+        } else {
+            (void) column_iterator_next(&iterator, &p);
+        }
+        if (!commands) {
+            if (pid_index_find(&seen_pids, p.pid) == -1 && pid_index_put(&seen_pids, p.pid, i) == -1) {
+                bail_out(EXIT_FAILURE, "could not grow set for exact distinct count");
+            }
+        } else if (column_dict_find(&seen_commands, heap->data, &heap->data[p.p_command_offset], p.p_command_length) < 0
+            && column_dict_add(&seen_commands, heap->data, p.p_command_offset, p.p_command_length) == -1) {
+            bail_out(EXIT_FAILURE, "could not grow set for exact distinct count");
+        }
+    }
+    int distinct;
+    if (commands) {
+        distinct = (int) seen_commands.count;
+        column_dict_free(&seen_commands);
+    } else {
+        distinct = (int) seen_pids.count;
+        pid_index_free(&seen_pids);
+    }
+    return distinct;
+}
+
+static int count_distinct(const struct request_slot *slot, uint64_t epoch) {
+    if ((slot->info != DISTINCT_COMMAND && slot->info != DISTINCT_PID) || slot->distinct_windows < 0 || slot->distinct_windows > DISTINCT_WINDOWS
+        || (slot->distinct_exact && slot->distinct_windows != 0)) {
+        return -1;
+    }
+    int commands = slot->info == DISTINCT_COMMAND;
+    struct hll sketch;
+    if (slot->distinct_windows != 0) {
+        /* the sketches of the windows get merged - a value seen in several windows still counts once */
+        long long number = monotonic_ns() / (DISTINCT_WINDOW_SECONDS * 1000000000LL);
+        hll_clear(&sketch);
+        for (long long n = number; n > number - slot->distinct_windows && n >= 0; --n) {
+            const struct distinct_window *window = &windows[n % DISTINCT_WINDOWS];
+            if (window->number == n) {
+                hll_merge(&sketch, commands ? &window->commands : &window->pids);
+            }
+        }
+        return (int) (hll_estimate(&sketch) + 0.5);
+    }
+    int count;
+    const struct process *rows = rows_as_of(epoch, &count);
+    if (slot->distinct_exact) {
+        return count <= DISTINCT_EXACT_ROWS ? count_exact(rows, count, commands) : -1;
+    }
+    if (epoch != current_epoch) {
+        /* only the current table has sketches of its own */
+        hll_clear(&sketch);
+        sketch_rows(rows, count, commands, &sketch);
+        return (int) (hll_estimate(&sketch) + 0.5);
+    }
+    if (sketches_stale) {
+        hll_clear(&table_pids);
+        hll_clear(&table_commands);
+        sketch_rows(rows, count, FALSE, &table_pids);
+        sketch_rows(rows, count, TRUE, &table_commands);
+        sketches_stale = FALSE;
+    }
+    return (int) (hll_estimate(commands ? &table_commands : &table_pids) + 0.5);
+}
+
+static void update_peak_versions(void) {
+    size_t bytes = version_memory(&versions);
+    for (int i = 0; i < COUNT_OF(views); ++i) {
+        if (views[i].rows != NULL) {
+            bytes += views[i].length * sizeof(struct process);
+        }
+    }
+    if (bytes > peak_version_bytes) {
+        peak_version_bytes = bytes;
+    }
+}
+
+static void serve_requests(void) {
+    uint64_t served[SLOT_COUNT];
+    uint64_t lsn = 0;
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        served[i] = __atomic_load_n(&shm->slots[i].lease, __ATOMIC_ACQUIRE);
+        if (LEASE_STATE(served[i]) != SLOT_REQUEST) {
+            continue;
+        }
+        copy_request(&request_copy, &shm->slots[i], served[i]);
+        if (request_seal(&request_copy, served[i]) != request_copy.seal) {
+            /* nothing gets done - the client of the slot hands its request over again */
+            request_copy.status = STATUS_OVERWRITTEN;
+            request_copy.value_d = -1;
+            printf("dropped overwritten request in slot %d of client %d\n", i, (int) LEASE_PID(served[i]));
+        } else {
+            uint64_t request_lsn = handle_request(&request_copy);
+            if (request_lsn > lsn) {
+                lsn = request_lsn;
+            }
+        }
+        copy_response(&shm->slots[i], &request_copy);
+    }
+    /* one wait makes every write of this round durable - reads wait as well so nobody sees a write that could still get lost */
+    if (lsn != 0 && wal_wait(&wal, lsn) == -1) {
+        bail_out(EXIT_FAILURE, "could not write write-ahead log");
+    }
+    publish_watches();
+    long long deadline = monotonic_ns() + LEASE_TIMEOUT_MS * 1000000LL;
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        if (LEASE_STATE(served[i]) != SLOT_REQUEST) {
+            continue;
+        }
+        struct request_slot *slot = &shm->slots[i];
+        uint64_t response = LEASE(LEASE_GENERATION(served[i]), SLOT_RESPONSE, LEASE_PID(served[i]));
+        lease_timers[i].lease = response;
+        lease_timers[i].deadline = deadline;
+        /* only the server moves a slot out of SLOT_REQUEST - a plain store is enough, no client can change the lease word in the meantime */
+        __atomic_store_n(&slot->lease, response, __ATOMIC_SEQ_CST);
+        /* a busy polling client sees the lease itself - only a parked one needs a post */
+        if (__atomic_exchange_n(&slot->client_parked, FALSE, __ATOMIC_SEQ_CST) && sem_post(&slot->response) == -1) {
+            bail_out(errno, "sem_post failed");
+        }
+    }
+}
+
+static void copy_request(struct request_slot *copy, const struct request_slot *slot, uint64_t lease) {
+    /* lease word, semaphore and park flag stay out - the server only uses them in the slot itself */
+    size_t start = offsetof(struct request_slot, pid);
+    size_t data = offsetof(struct request_slot, request_data);
+    size_t tail = offsetof(struct request_slot, watch_pid);
+    (void) memcpy((char *) copy + start, (const char *) slot + start, data - start);
+    size_t length = copy->request_length > REQUEST_DATA_SIZE ? REQUEST_DATA_SIZE : copy->request_length;
+    (void) memcpy(copy->request_data, slot->request_data, length);
+    (void) memcpy((char *) copy + tail, (const char *) slot + tail, sizeof *copy - tail);
+    copy->lease = lease;
+}
+
+static void copy_response(struct request_slot *slot, const struct request_slot *copy) {
+    slot->status = copy->status;
+    slot->value_d = copy->value_d;
+    slot->value_offset = copy->value_offset;
+    slot->value_length = copy->value_length;
+    (void) memcpy(slot->stats, copy->stats, sizeof slot->stats);
+    slot->cursor = copy->cursor;
+    slot->page_rows = copy->page_rows;
+    slot->page_bytes = copy->page_bytes;
+    slot->epoch = copy->epoch;
+}
 
-/**
- * @brief free allocated resources
- */
-static void free_resources(void);
+static int requests_ready(void) {
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        if (LEASE_STATE(__atomic_load_n(&shm->slots[i].lease, __ATOMIC_SEQ_CST)) == SLOT_REQUEST) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 
-/**
- * @brief Parse command line options
- * @param argc The argument counter
- * @param argv The argument vector
- * @param options Struct where parsed arguments are stored
- */
-static void parse_args(int argc, char **argv);
+static void wait_for_work(void) {
+    if (poll_cpu != -1) {
+        /* spin, then spin with pause, then yield - an idle server gives up its core after a few hundred microseconds */
+        for (int n = poll_start; n < POLL_SPINS + POLL_PAUSES + POLL_YIELDS; ++n) {
+            if (requests_ready()) {
+                return;
+            }
+            if (n >= POLL_SPINS + POLL_PAUSES) {
+                (void) sched_yield();
+            } else if (n >= POLL_SPINS) {
+                CPU_RELAX();
+            }
+        }
+        /* park - a client that hands over its request after this store sees the flag and posts work */
+        __atomic_store_n(&shm->server_parked, TRUE, __ATOMIC_SEQ_CST);
+        if (requests_ready()) {
+            __atomic_store_n(&shm->server_parked, FALSE, __ATOMIC_SEQ_CST);
+            return;
+        }
+    }
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += WAIT_INTERVAL_MS * 1000000L;
+    timeout.tv_sec += timeout.tv_nsec / 1000000000L;
+    timeout.tv_nsec %= 1000000000L;
+    if (sem_timedwait(&shm->work, &timeout) == -1) {
+        if (errno != EINTR && errno != ETIMEDOUT) {
+            bail_out(errno, "sem_timedwait failed");
+        }
+        errno = 0;
+    }
+    if (poll_cpu != -1) {
+        __atomic_store_n(&shm->server_parked, FALSE, __ATOMIC_SEQ_CST);
+    }
+}
 
-/**
- * @brief Signal handler for SIGINT & SIGTERM which should shut down the server
- * @param sig Signal number catched
- */
-static void signal_quit_handler(int sig);
+static void reclaim_slots(void) {
+    long long now = monotonic_ns();
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        struct request_slot *slot = &shm->slots[i];
+        uint64_t lease = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+        int state = LEASE_STATE(lease);
+        pid_t owner = LEASE_PID(lease);
+        /* requests that are ready get answered anyway - the slot gets reclaimed once the response is not read */
+        if (owner == 0 || state == SLOT_REQUEST) {
+            continue;
+        }
+        struct lease_timer *timer = &lease_timers[i];
+        if (timer->lease != lease) {
+            timer->lease = lease;
+            timer->deadline = now + LEASE_TIMEOUT_MS * 1000000LL;
+        }
+        int dead = kill(owner, 0) == -1 && errno == ESRCH;
+        int expired = now > timer->deadline;
+        if (!dead && !expired) {
+            continue;
+        }
+        /* a new generation makes every later compare and swap of the old client fail */
+        uint64_t free_lease = LEASE(LEASE_GENERATION(lease) + 1, SLOT_FREE, 0);
+        if (!__atomic_compare_exchange_n(&slot->lease, &lease, free_lease, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        /* a response nobody read must not wake up the next client of the slot */
+        while (sem_trywait(&slot->response) == 0) {
+        }
+        printf("reclaimed slot %d of %s client %d\n", i, dead ? "dead" : "stalled", (int) owner);
+    }
+    for (int i = 0; i < WATCH_COUNT; ++i) {
+        pid_t owner = __atomic_load_n(&shm->watches[i].owner, __ATOMIC_ACQUIRE);
+        if (owner != 0 && kill(owner, 0) == -1 && errno == ESRCH) {
+            __atomic_store_n(&shm->watches[i].owner, 0, __ATOMIC_RELEASE);
+            printf("reclaimed watch %d of dead client %d\n", i, (int) owner);
+        }
+    }
+    for (int i = 0; i < SCAN_CURSORS; ++i) {
+        pid_t owner = shm->cursors[i].owner;
+        if (owner != 0 && ((kill(owner, 0) == -1 && errno == ESRCH) || now > scans[i].deadline)) {
+            close_cursor(i);
+            printf("reclaimed cursor %d of client %d\n", i, (int) owner);
+        }
+    }
+    collect_versions();
+    errno = 0;
+}
 
-/**
- * @brief Signal handler for SIGUSR1 which should print all data in the database
- * @param sig Signal number catched
- */
-static void signal_print_db_handler(int sig);
+static long long monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
 
-/**
- * @brief this funciton calculates and returns the result of the calculation of min/max/sum/avg over all processes
- * @param command 0 - min, 1 - max, 2 - sum, 3 - avg
- * @param field 0 - cpu, 1 - mem, 2 - time
- * @return returns the result as an integer
- */
-static int calculate_min_max_sum_avg(int command, int field);
+static void recover(const char *input_path) {
+    if (mkdir(wal_dir, 0700) == -1 && errno != EEXIST) {
+        bail_out(EXIT_FAILURE, "could not create write-ahead log directory %s", wal_dir);
+    }
+    errno = 0;
+    char snapshot_path[PATH_MAX];
+    uint64_t lsn = 0;
+    if (wal_find_snapshot(wal_dir, &lsn, snapshot_path, sizeof snapshot_path)) {
+        printf("reading snapshot %s instead of input-file\n", snapshot_path);
+        read_input_file(snapshot_path);
+    } else {
+        read_input_file(input_path);
+    }
+    uint64_t last_lsn;
+    long replayed = wal_replay(wal_dir, lsn, replay_record, &last_lsn);
+    if (replayed == -1) {
+        bail_out(EXIT_FAILURE, "could not replay write-ahead log");
+    }
+    printf("replayed %ld records of the write-ahead log\n", replayed);
+    if (wal_open(&wal, wal_dir, last_lsn + 1) == -1) {
+        bail_out(EXIT_FAILURE, "could not open write-ahead log");
+    }
+}
 
-/**
- * @brief this funciton searches the list of processes and returns the value
- * @param pid for wich to look for
- * @param field 0 - cpu, 1 - mem, 2 - time
- * @return returns the value if it was found - otherwise -1
- */
-static int get_cpu_mem_time(int pid, int field);
+static int write_snapshot_rows(FILE *file) {
+    for (int i = 0; i < count_porccesses; ++i) {
+        if (fprintf(file, "%d,%d,%d,%d,%.*s\n", processes[i].pid, processes[i].p_cpu, processes[i].p_mem, processes[i].p_time,
+            (int) processes[i].p_command_length, &heap->data[processes[i].p_command_offset]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
 
+static void check_snapshot(void) {
+    if (wal_dir == NULL) {
+        return;
+    }
+    if (snapshot_pid != -1) {
+        int status;
+        pid_t result = waitpid(snapshot_pid, &status, WNOHANG);
+        if (result == 0) {
+            return;
+        }
+        if (result == snapshot_pid && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            wal_remove_obsolete(wal_dir, snapshot_lsn);
+        } else {
+            printf("writing snapshot %llu failed - the write-ahead log gets kept\n", (unsigned long long) snapshot_lsn);
+        }
+        snapshot_pid = -1;
+    }
+    if (logged_bytes < WAL_COMPACT_BYTES) {
+        return;
+    }
+    /* the snapshot process gets a copy-on-write view of the rows as they are right now - the server keeps running */
+    snapshot_lsn = wal_rotate(&wal);
+    logged_bytes = 0;
+    snapshot_pid = fork();
+    if (snapshot_pid == -1) {
+        printf("could not fork snapshot process\n");
+        return;
+    }
+    if (snapshot_pid == 0) {
+        _exit(wal_write_snapshot(wal_dir, snapshot_lsn, write_snapshot_rows) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+}
 
-static void bail_out(int exitcode, const char *fmt, ...) {
-    va_list ap;
+static void setup_string_heap(void) {
+    heap_fd = shm_open(SHM_STRING_HEAP, O_RDWR | O_CREAT, PERMISSION);
+    if (heap_fd == -1) {
+        bail_out(errno, "could not set up string heap");
+    }
+    if (ftruncate(heap_fd, sizeof *heap + HEAP_INITIAL_CAPACITY) == -1) {
+        bail_out(errno, "could not ftruncate string heap");
+    }
+    heap = mmap(NULL, sizeof *heap + HEAP_INITIAL_CAPACITY, PROT_READ | PROT_WRITE, MAP_SHARED, heap_fd, 0);
+    if (heap == MAP_FAILED) {
+        heap = NULL;
+        bail_out(errno, "could not mmap string heap");
+    }
+    heap->capacity = HEAP_INITIAL_CAPACITY;
+    heap->used = 0;
+}
 
-    (void) fprintf(stderr, "%s: ", progname);
-    if (fmt != NULL) {
-        va_start(ap, fmt);
-        (void) vfprintf(stderr, fmt, ap);
-        va_end(ap);
+static int heap_grow(size_t length) {
+    if (heap->used + length <= heap->capacity) {
+        return 0;
     }
-    if (errno != 0) {
-        (void) fprintf(stderr, ": %s", strerror(errno));
+    size_t old_capacity = heap->capacity;
+    size_t new_capacity = old_capacity;
+    while (heap->used + length > new_capacity) {
+        new_capacity *= 2;
     }
-    (void) fprintf(stderr, "\n");
+    /* the pages get allocated right away - a heap bigger than /dev/shm would otherwise end the server with SIGBUS on the first write */
+    int error = posix_fallocate(heap_fd, 0, sizeof *heap + new_capacity);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    /* clients notice the bigger capacity and remap on their own */
+    if (munmap(heap, sizeof *heap + old_capacity) == -1) {
+        heap = NULL;
+        bail_out(errno, "could not munmap string heap");
+    }
+    heap = mmap(NULL, sizeof *heap + new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, heap_fd, 0);
+    if (heap == MAP_FAILED) {
+        heap = NULL;
+        bail_out(errno, "could not mmap string heap");
+    }
+    heap->capacity = new_capacity;
+    region_advise_huge(heap, sizeof *heap + new_capacity);
+    return 0;
+}
 
-    free_resources();
-    exit(exitcode);
+static size_t heap_append(const char *str, size_t length) {
+    if (heap_grow(length) == -1) {
+        bail_out(errno, "could not grow string heap");
+    }
+    size_t offset = heap->used;
+    memcpy(&heap->data[offset], str, length);
+    heap->used += length;
+    return offset;
 }
 
-static void free_resources(void) {
-    printf("freeing resources\n");
-    if (processes != NULL) {
-        free(processes);
+static int heap_size_class(size_t length) {
+    int c = 0;
+    while (c < HEAP_SIZE_CLASSES - 1 && length >> (c + 1) != 0) {
+        ++c;
     }
-    if (server_set_up) {
-        /* unmap shared memory */
-        if (munmap(shm, sizeof *shm) == -1) {
-            printf("could not munmap shared memory");
+    return c;
+}
+
+static int heap_find_block(size_t length, size_t *position) {
+    int c = heap_size_class(length);
+    /* blocks of the own class can be too small - only the newest few get tried */
+    struct heap_blocks *list = &free_blocks[c];
+    for (size_t i = 0; i < list->count && i < HEAP_FIT_SCAN; ++i) {
+        if (list->blocks[list->count - 1 - i].length >= length) {
+            *position = list->count - 1 - i;
+            return c;
         }
-        /* remove shared memory */
-        if (shm_unlink(SHM_SERVER) == -1) {
-            printf("could not unlink shared memory");
+    }
+    /* every block of a bigger class fits */
+    for (++c; c < HEAP_SIZE_CLASSES; ++c) {
+        if (free_blocks[c].count > 0) {
+            *position = free_blocks[c].count - 1;
+            return c;
         }
     }
-    if (server != 0) {
-        if (sem_close(server) == -1) {
-            printf("could not close server semaphore");
+    return -1;
+}
+
+static size_t heap_alloc(const char *str, size_t length) {
+    size_t position;
+    int c = length == 0 ? -1 : heap_find_block(length, &position);
+    if (c == -1) {
+        return heap_append(str, length);
+    }
+    struct heap_blocks *list = &free_blocks[c];
+    struct heap_block block = list->blocks[position];
+    list->blocks[position] = list->blocks[--list->count];
+    /* the rest of the block stays free */
+    heap_free(block.offset + length, block.length - length);
+    memcpy(&heap->data[block.offset], str, length);
+    return block.offset;
+}
+
+static int heap_reserve(size_t length) {
+    size_t position;
+    if (heap_find_block(length, &position) != -1) {
+        return 0;
+    }
+    return heap_grow(length);
+}
+
+static void heap_blocks_push(struct heap_blocks *list, const struct heap_block *block) {
+    if (list->count == list->length) {
+        size_t length = list->length == 0 ? 64 : 2 * list->length;
+        struct heap_block *grown = realloc(list->blocks, length * sizeof *grown);
+        if (grown == NULL) {
+            bail_out(EXIT_FAILURE, "could not grow list of string heap blocks");
         }
+        list->blocks = grown;
+        list->length = length;
+    }
+    list->blocks[list->count++] = *block;
+}
+
+static void heap_free(size_t offset, size_t length) {
+    if (length == 0) {
+        return;
     }
-    if (client != 0) {
-        if (sem_close(client) == -1) {
-            printf("could not close client semaphore");
+    struct heap_block block = {offset, length, 0, 0};
+    heap_blocks_push(&free_blocks[heap_size_class(length)], &block);
+}
+
+static int compare_offset(const void *a, const void *b) {
+    const struct heap_block *ba = a;
+    const struct heap_block *bb = b;
+    return (ba->offset > bb->offset) - (ba->offset < bb->offset);
+}
+
+static void heap_coalesce(void) {
+    struct heap_blocks all = {NULL, 0, 0};
+    for (int c = 0; c < HEAP_SIZE_CLASSES; ++c) {
+        for (size_t i = 0; i < free_blocks[c].count; ++i) {
+            heap_blocks_push(&all, &free_blocks[c].blocks[i]);
         }
+        free_blocks[c].count = 0;
     }
-    if (interaction_started != 0) {
-        if (sem_close(interaction_started) == -1) {
-            printf("could not close interaction_started semaphore");
+    qsort(all.blocks, all.count, sizeof *all.blocks, compare_offset);
+    size_t merged = 0;
+    for (size_t i = 0; i < all.count; ++i) {
+        if (merged > 0 && all.blocks[merged - 1].offset + all.blocks[merged - 1].length == all.blocks[i].offset) {
+            all.blocks[merged - 1].length += all.blocks[i].length;
+        } else {
+            all.blocks[merged++] = all.blocks[i];
         }
     }
-    if (server_set_up) {
-        if (sem_unlink(SEM_SERVER) == -1) {
-            printf("could not unlink server sempahore");
+    if (merged > 0 && all.blocks[merged - 1].offset + all.blocks[merged - 1].length == heap->used) {
+        heap->used = all.blocks[--merged].offset;
+    }
+    for (size_t i = 0; i < merged; ++i) {
+        heap_free(all.blocks[i].offset, all.blocks[i].length);
+    }
+    free(all.blocks);
+}
+
+static void retire_string(const struct process *p) {
+    /* in the compressed layout rows share their command lines - they are read-only anyway */
+    if (compressed) {
+        return;
+    }
+    struct heap_block block = {p->p_command_offset, p->p_command_length, current_epoch + 1, 0};
+    heap_blocks_push(&retired_strings, &block);
+}
+
+static void reclaim_strings(uint64_t horizon) {
+    long long now = monotonic_ns();
+    size_t freed = 0;
+    for (size_t i = 0; i < retired_strings.count; ++i) {
+        struct heap_block *block = &retired_strings.blocks[i];
+        /* the command lines got retired in the order of the epochs - the rest is still read */
+        if (block->epoch > horizon) {
+            break;
         }
-        if (sem_unlink(SEM_CLIENT) == -1) {
-            printf("could not unlink client sempahore");
+        if (block->unread == 0) {
+            block->unread = now;
         }
-        if (sem_unlink(SEM_INTERACTION_STARTED) == -1) {
-            printf("could not unlink interaction_started sempahore");
+        /* the snapshot process writes the rows as they were at the fork and reads their command lines in the shared heap */
+        if (freed == i && snapshot_pid == -1 && now - block->unread >= HEAP_GRACE_MS * 1000000LL) {
+            heap_free(block->offset, block->length);
+            ++freed;
         }
     }
+    if (freed > 0) {
+        retired_strings.count -= freed;
+        (void) memmove(retired_strings.blocks, &retired_strings.blocks[freed], retired_strings.count * sizeof *retired_strings.blocks);
+        /* split blocks would otherwise only ever get smaller */
+        heap_coalesce();
+    }
 }
 
-static void parse_args(int argc, char **argv) {
-    if(argc > 0) {
-        progname = argv[0];
+static size_t store_command(const char *str, size_t length) {
+    if (!compressed) {
+        return heap_alloc(str, length);
     }
-    if (argc != 2) {
-        bail_out(EXIT_FAILURE, "needs input-file - usage: procdb-server input-file");
+    long id = column_dict_find(&dictionary, heap->data, str, length);
+    if (id >= 0) {
+        return dictionary.offset[id];
     }
-    /* open input-file and read line by line - save content */
-    FILE *input_file;
-    input_file = fopen(argv[1], "r");
-    if (input_file == NULL) {
-        bail_out(EXIT_FAILURE, "could not open file - enter valid file - usage: procdb-server input-file");
+    size_t offset = heap_append(str, length);
+    if (column_dict_add(&dictionary, heap->data, offset, length) == -1) {
+        bail_out(EXIT_FAILURE, "could not grow command dictionary");
     }
-    char *line = malloc((size_t) LINE_SIZE);
-    while (fgets(line, (size_t) LINE_SIZE, input_file) != NULL) {
-        struct process p;
-
-        char *s = strtok(line,",");
-        int cnt = 0; // 0 - pid, 1 - cpu, 2 - mem, 3 - time, 4 - command
-        int i;
-        char *endptr = NULL;
-        while (s != NULL) {
-            if (cnt > 4) {
-                bail_out(EXIT_FAILURE, "too many arguments in input-file");
-            }
-            if (cnt != 4) {
-                endptr = NULL;
-                i = strtol(s, &endptr, 10);
-                if (endptr == s || strcmp("", endptr) != 0  || ((i == LONG_MAX || i == LONG_MIN) && errno == ERANGE)) {
-                    bail_out(EXIT_FAILURE, "invalid int in input-file");
-                }
-            } 
-            switch (cnt) {
-            case 0:
-                p.pid = i;
-                break;
-            case 1:
-                p.p_cpu = i;
-                break;
-            case 2:
-                p.p_mem = i;
-                break;
-            case 3:
-                p.p_time = i;
-                break;
-            case 4:
-                p.p_command = strdup(s);
-                break;
-            default:
-                bail_out(EXIT_FAILURE, "too many arguments in one line in input-file");
-            }
-            s = strtok(NULL,",");
-            ++ cnt;
-        }
+    return offset;
+}
 
-        if (count_porccesses+1 >= length_porccesses) {
-            length_porccesses += 5;
-            processes = (struct process*) realloc(processes, length_porccesses*sizeof(struct process));
-        }
-        processes[count_porccesses] = p;
-        count_porccesses ++;
-    } if (feof(input_file) == 0) {
-        bail_out(EXIT_FAILURE, "could not properly read input-file");
+static void compress_processes(void) {
+    size_t command_bytes = 0;
+    for (int i = 0; i < count_porccesses; ++i) {
+        command_bytes += processes[i].p_command_length;
     }
-    if (fclose(input_file) != 0) {
-        bail_out(EXIT_FAILURE, "could not properly close input-file after read");
+    if (column_build(&columns, processes, count_porccesses, &dictionary) == -1) {
+        bail_out(EXIT_FAILURE, "could not build compressed columns");
     }
+    region_free(processes, length_porccesses*sizeof(struct process));
+    processes = NULL;
+    length_porccesses = 0;
+
+    /* the uncompressed layout keeps one struct process and one copy of the command line per row */
+    size_t rows = count_porccesses > 0 ? count_porccesses : 1;
+    size_t uncompressed = count_porccesses * sizeof(struct process) + command_bytes;
+    size_t compressed_bytes = column_memory(&columns) + heap->used;
+    printf("compressed %d processes into %zu blocks: %zu bytes (%.2f bytes/row) - uncompressed %zu bytes (%.2f bytes/row), %u distinct commands\n",
+        count_porccesses, columns.block_count, compressed_bytes, (double) compressed_bytes / rows, uncompressed, (double) uncompressed / rows, dictionary.count);
 }
 
 static void signal_quit_handler(int sig) {
@@ -273,69 +2091,137 @@ static void signal_print_db_handler(int sig) {
     print_db = 1;
 }
 
-static int calculate_min_max_sum_avg(int command, int field) {
-    int min = INT_MAX;
-    int max = INT_MIN;
-    int sum = 0;
-    int cnt = 0;
-    for (int i = 0; i < count_porccesses; ++i) {
-        if (field == 0) {
-            if (processes[i].p_cpu < min) {
-                min = processes[i].p_cpu;
-            } if (processes[i].p_cpu > max) {
-                max = processes[i].p_cpu;
-            }
-            sum += processes[i].p_cpu;
-        } else if (field == 1) {
-            if (processes[i].p_mem < min) {
-                min = processes[i].p_mem;
-            } if (processes[i].p_mem > max) {
-                max = processes[i].p_mem;
-            }
-            sum += processes[i].p_mem;
-        } else if (field == 2) {
-            if (processes[i].p_time < min) {
-                min = processes[i].p_time;
-            } if (processes[i].p_time > max) {
-                max = processes[i].p_time;
-            }
-            sum += processes[i].p_time;
-        } else {
-            bail_out(EXIT_FAILURE, "wrong input received at server end for calculating min/max/sum/avg - non existing field (cpu/mem/time)");
+/*
+ * the stats kernels scan the list of processes once and calculate min, max and sum of several fields. there is one kernel
+ * for every combination of fields (F - 1 cpu, 2 mem, 4 time) and aggregates (A - 1 min, 2 max, 4 sum) so the loop does
+ * not branch on what was asked for - the conditions on F and A are constants the compiler removes.
+ */
+#define STATS_ACCUMULATE(F, A, bit, index, value) \
+    if ((F) & (bit)) { \
+        if (((A) & 1) && (value) < local_min[index]) { \
+            local_min[index] = (value); \
+        } \
+        if (((A) & 2) && (value) > local_max[index]) { \
+            local_max[index] = (value); \
+        } \
+        if ((A) & 4) { \
+            local_sum[index] += (value); \
+        } \
+    }
+
+#define STATS_KERNEL(F, A) \
+static void stats_kernel_##F##_##A(const struct process *rows, int count, int min[STATS_FIELDS], int max[STATS_FIELDS], long long sum[STATS_FIELDS]) { \
+    int local_min[STATS_FIELDS] = {min[0], min[1], min[2]}; \
+    int local_max[STATS_FIELDS] = {max[0], max[1], max[2]}; \
+    long long local_sum[STATS_FIELDS] = {sum[0], sum[1], sum[2]}; \
+    for (int i = 0; i < count; ++i) { \
+        STATS_ACCUMULATE(F, A, 1, 0, rows[i].p_cpu) \
+        STATS_ACCUMULATE(F, A, 2, 1, rows[i].p_mem) \
+        STATS_ACCUMULATE(F, A, 4, 2, rows[i].p_time) \
+    } \
+    for (int f = 0; f < STATS_FIELDS; ++f) { \
+        min[f] = local_min[f]; \
+        max[f] = local_max[f]; \
+        sum[f] = local_sum[f]; \
+    } \
+}
+
+#define STATS_KERNELS(F) \
+    STATS_KERNEL(F, 1) STATS_KERNEL(F, 2) STATS_KERNEL(F, 3) STATS_KERNEL(F, 4) \
+    STATS_KERNEL(F, 5) STATS_KERNEL(F, 6) STATS_KERNEL(F, 7)
+
+#define STATS_KERNEL_ROW(F) \
+    {NULL, stats_kernel_##F##_1, stats_kernel_##F##_2, stats_kernel_##F##_3, stats_kernel_##F##_4, \
+    stats_kernel_##F##_5, stats_kernel_##F##_6, stats_kernel_##F##_7}
+
+STATS_KERNELS(1)
+STATS_KERNELS(2)
+STATS_KERNELS(3)
+STATS_KERNELS(4)
+STATS_KERNELS(5)
+STATS_KERNELS(6)
+STATS_KERNELS(7)
+
+/**
+ * @brief kernels indexed by the bitmask of the fields and the bitmask of min/max/sum
+ */
+static void (*const stats_kernels[8][8])(const struct process *, int, int[STATS_FIELDS], int[STATS_FIELDS], long long[STATS_FIELDS]) = {
+    {NULL},
+    STATS_KERNEL_ROW(1),
+    STATS_KERNEL_ROW(2),
+    STATS_KERNEL_ROW(3),
+    STATS_KERNEL_ROW(4),
+    STATS_KERNEL_ROW(5),
+    STATS_KERNEL_ROW(6),
+    STATS_KERNEL_ROW(7)
+};
+
+static int calculate_stats(const struct process *rows, int count, int aggregates, int fields, long long results[STATS_FIELDS][STATS_AGGREGATES]) {
+    /* clients that do not use libprocdb can send anything - a wrong request only fails itself */
+    if (fields <= 0 || fields > 7 || aggregates <= 0 || aggregates > 15) {
+        memset(results, 0, STATS_FIELDS * sizeof results[0]);
+        return STATUS_INVALID;
+    }
+    int min[STATS_FIELDS];
+    int max[STATS_FIELDS];
+    long long sum[STATS_FIELDS];
+    for (int f = 0; f < STATS_FIELDS; ++f) {
+        min[f] = INT_MAX;
+        max[f] = INT_MIN;
+        sum[f] = 0;
+    }
+    if (compressed) {
+        column_stats(&columns, fields, min, max, sum);
+    } else {
+        /* avg needs the sum */
+        int kernel = (aggregates & 7) | ((aggregates & 8) ? 4 : 0);
+        stats_kernels[fields][kernel](rows, count, min, max, sum);
+    }
+    for (int f = 0; f < STATS_FIELDS; ++f) {
+        long long values[STATS_AGGREGATES] = {min[f], max[f], sum[f], count > 0 ? sum[f] / count : 0};
+        for (int a = 0; a < STATS_AGGREGATES; ++a) {
+            results[f][a] = ((fields & (1 << f)) && (aggregates & (1 << a))) ? values[a] : 0;
         }
-        ++cnt;
     }
-    if (command == 0) {
-        return min;
-    } else if (command == 1) {
-        return max;
-    } else if (command == 2) {
-        return sum;
-    } else if (command == 3) {
-        return sum/cnt;
+    return STATUS_OK;
+}
+
+static int calculate_min_max_sum_avg(const struct process *rows, int count, int command, int field, int *result) {
+    *result = -1;
+    if (field < 0 || field > 2 || command < 0 || command > 3) {
+        return STATUS_INVALID;
     }
-    bail_out(EXIT_FAILURE, "wrong input received at server end for calculating min/max/sum/avg - non existing command (min/max/sum/avg)");
-    return 0;
+    if (compressed) {
+        *result = (int) column_aggregate(&columns, command, field);
+        return STATUS_OK;
+    }
+    /* a single aggregate is a stats request with one field and one aggregate */
+    long long results[STATS_FIELDS][STATS_AGGREGATES];
+    (void) calculate_stats(rows, count, 1 << command, 1 << field, results);
+    *result = (int) results[field][command];
+    return STATUS_OK;
 }
 
-static int get_cpu_mem_time(int pid, int field) {
-    for (int i = 0; i < count_porccesses; ++i) {
-        if (processes[i].pid == pid) {
-            if (field == 0) {
-                return processes[i].p_cpu;
-            } else if (field == 1) {
-                return processes[i].p_mem;
-            } else if (field == 2) {
-                return processes[i].p_time;
-            } else {
-                if (field == 3) {
-                    return -1;
-                }
-                bail_out(EXIT_FAILURE, "wrong input received at server end for calculating min/max/sum/avg - non existing field (cpu/mem/time)");
-            }
-        }
+static int get_cpu_mem_time(int pid, int field, uint64_t epoch, int *value) {
+    struct process p;
+    *value = -1;
+    if (field < 0 || field > 2) {
+        return STATUS_INVALID;
     }
-    return -1;
+    if (lookup_process(pid, epoch, &p)) {
+        *value = field == 0 ? p.p_cpu : field == 1 ? p.p_mem : p.p_time;
+    }
+    return STATUS_OK;
+}
+
+static int get_command(int pid, uint64_t epoch, size_t *offset, size_t *length) {
+    struct process p;
+    if (lookup_process(pid, epoch, &p) == FALSE) {
+        return FALSE;
+    }
+    *offset = p.p_command_offset;
+    *length = p.p_command_length;
+    return TRUE;
 }
 
 /**
@@ -375,12 +2261,8 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    /* reserve list of processes to save stuff from input-file in */
-    processes = malloc(sizeof(struct process)*5);
-    length_porccesses = 5;
-
     /* setup shared memory */
-    int shmfd = shm_open(SHM_SERVER, O_RDWR | O_CREAT, PERMISSION);
+    int shmfd = shm_open(SHM_SERVER, O_RDWR | O_CREAT | O_EXCL, PERMISSION);
     if (shmfd == -1) {
         bail_out(errno, "could not set up server shared memory");
     }
@@ -397,101 +2279,60 @@ int main(int argc, char *argv[]) {
         bail_out(errno, "could not close shm file descriptor");
     }
 
-    /* set up semaphores */
-    client = sem_open(SEM_CLIENT, O_CREAT | O_EXCL, PERMISSION, 0);
-    if (client == SEM_FAILED) {
-        bail_out(errno, "could not set up client sempahore");
+    /* set up semaphores - they live in the shared memory so every slot can have one of its own */
+    if (sem_init(&shm->work, 1, 0) == -1) {
+        bail_out(errno, "could not set up work sempahore");
     }
-    server = sem_open(SEM_SERVER, O_CREAT | O_EXCL, PERMISSION, 1);
-    if (server == SEM_FAILED) {
-        bail_out(errno, "could not set up server sempahore");
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        if (sem_init(&shm->slots[i].response, 1, 0) == -1) {
+            bail_out(errno, "could not set up response sempahore");
+        }
     }
-    interaction_started = sem_open(SEM_INTERACTION_STARTED, O_CREAT | O_EXCL, PERMISSION, 0);
-    if (interaction_started == SEM_FAILED) {
-        bail_out(errno, "could not set up interaction_started sempahore");
+    for (int i = 0; i < WATCH_COUNT; ++i) {
+        if (sem_init(&shm->watches[i].notify, 1, 0) == -1) {
+            bail_out(errno, "could not set up notify sempahore");
+        }
     }
+    shm->server_parked = TRUE;
+    server_set_up = 1;
+
+    /* set up the string heap the command lines get stored in */
+    setup_string_heap();
 
     /* parse arguments */
     parse_args(argc, argv);
 
-    server_set_up = 1;
-
-    /* set shared memory to default values */
-    if (sem_wait(server) == -1) {
-        bail_out(errno, "sem_wait failed");
-    }
-    /* critical section start */
-    shm->pid = -1;
-    shm->pid_cmd = -1;
-    shm->info = -1;
-    (void)strncpy(shm->value, "no command\0", LINE_SIZE-1);
-    shm->value_d = -1;
-    /* critical section end */
-    if (sem_post(server) == -1) {
-        bail_out(errno, "sem_post failed");
-    }
-    if (sem_post(client) == -1) {
-        bail_out(errno, "sem_post failed");
-    }
-    if (sem_post(interaction_started) == -1) {
-        bail_out(errno, "sem_post failed");
-    }
+    /* clients wait with their first request until the data is loaded */
+    __atomic_store_n(&shm->server_pid, getpid(), __ATOMIC_RELEASE);
 
     /* wait for requests of clients, and write back answers */
     while (TRUE) {
         if (quit == 1) {
             printf("caught signal - shutting down\n");
+            printf("epoch %llu - versions used at most %zu bytes\n", (unsigned long long) current_epoch, peak_version_bytes);
             break;
         }
+        check_snapshot();
         if (print_db == 1) {
+            struct column_iterator iterator;
+            column_iterator_init(&iterator, &columns, 0);
             for (int i = 0; i < count_porccesses; ++i) {
-                printf("proccess - pid: %d, cpu: %d, mem: %d, time: %d, command: %s\n", processes[i].pid, processes[i].p_cpu, processes[i].p_mem, processes[i].p_time, processes[i].p_command);
-            }
-            print_db = 0;
-        }
-        /* wait for client to connect then read the request and write the response */
-        if (sem_wait(server) == -1) {
-            if (errno == EINTR) {
-                continue;
-            }
-            bail_out(errno, "sem_wait failed");
-        }
-        /* critical section start */
-        if (shm->pid_cmd != -1) {
-            shm->value_d = calculate_min_max_sum_avg(shm->pid_cmd, shm->info);
-        } else {
-            if (shm->info == 3) {
-                for (int i = 0; i < count_porccesses; ++i) {
-                    if (processes[i].pid == shm->pid) {
-                        memset(&shm->value[0], 0, sizeof(shm->value));
-                        (void)strncpy(shm->value, processes[i].p_command, LINE_SIZE-1);
-                    }
+                struct process p;
+                if (compressed) {
+                    (void) column_iterator_next(&iterator, &p);
+                } else {
+                    p = processes[i];
                 }
-            } else {
-                shm->value_d = get_cpu_mem_time(shm->pid, shm->info);
+                printf("proccess - pid: %d, cpu: %d, mem: %d, time: %d, command: %.*s\n", p.pid, p.p_cpu, p.p_mem, p.p_time, (int) p.p_command_length, &heap->data[p.p_command_offset]);
             }
+            print_db = 0;
         }
-        /* critical section end */
-        if (sem_post(client) == -1) {
-            bail_out(errno, "sem_post failed");
-        }
-
-        /* clean up as soon as the client finished reading */
-        if (sem_wait(server) == -1) {
-            if (errno == EINTR) {
-                continue;
-            }
-            bail_out(errno, "sem_wait failed");
-        }
-        /* critical seciton start */
-        shm->pid = -1;
-        shm->pid_cmd = -1;
-        shm->info = -1;
-        (void)strncpy(shm->value, "no command\0", LINE_SIZE-1);
-        shm->value_d = -1;
-        /* critical section end */
-        if (sem_post(client) == -1) {
-            bail_out(errno, "sem_post failed");
+        /* wait for a request - but never longer than WAIT_INTERVAL_MS so slots of dead clients get reclaimed */
+        wait_for_work();
+        serve_requests();
+        if (monotonic_ns() >= next_reclaim) {
+            reclaim_slots();
+            next_reclaim = monotonic_ns() + WAIT_INTERVAL_MS * 1000000LL;
         }
     }
 
@@ -0,0 +1,196 @@
+/**
+ * @file procdb-version.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief old versions of the rows of procdb-server - they let readers see the table as it was at an older epoch
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb-version.h"
+#include "procdb-memory.h"
+
+/**
+ * @brief initial number of versions of a store
+ */
+#define VERSION_INITIAL_LENGTH (1024)
+
+/**
+ * @brief rebuilds the position of the newest version of every pid
+ * @param store store to rebuild
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+static int rebuild_heads(struct version_store *store);
+
+
+int version_init(struct version_store *store, uint64_t epoch) {
+    store->versions = NULL;
+    store->first = 0;
+    store->count = 0;
+    store->length = 0;
+    store->oldest = epoch;
+    return pid_index_init(&store->heads);
+}
+
+int version_add(struct version_store *store, uint64_t epoch, int op, int row, int pid, const struct process *before, uint64_t newest) {
+    int head = pid_index_find(&store->heads, pid);
+    if (op == WRITE_UPDATE && head != -1 && (size_t) head >= store->first && store->versions[head].epoch > newest
+        && store->versions[head].op == WRITE_UPDATE && store->versions[head].row == row) {
+        /* every reader either sees the row now or undoes the last version of the row too - that one overwrites the whole row */
+        return 0;
+    }
+    if (store->count == store->length) {
+        size_t length = store->length == 0 ? VERSION_INITIAL_LENGTH : 2 * store->length;
+        struct version *grown = store->versions == NULL ? region_alloc(length * sizeof *grown)
+            : region_realloc(store->versions, store->length * sizeof *grown, length * sizeof *grown);
+        if (grown == NULL) {
+            return -1;
+        }
+        store->versions = grown;
+        store->length = length;
+    }
+    struct version *v = &store->versions[store->count];
+    v->epoch = epoch;
+    v->op = op;
+    v->row = row;
+    v->pid = pid;
+    v->prev = head;
+    if (op != WRITE_INSERT) {
+        v->before = *before;
+    }
+    if (pid_index_put(&store->heads, pid, store->count) == -1) {
+        return -1;
+    }
+    ++store->count;
+    return 0;
+}
+
+int version_lookup(const struct version_store *store, const struct process *current, int pid, uint64_t epoch, struct process *p) {
+    /* the oldest version newer than the epoch has the row as it was at the epoch */
+    const struct version *oldest_newer = NULL;
+    for (int pos = pid_index_find(&store->heads, pid); pos != -1 && (size_t) pos >= store->first; pos = store->versions[pos].prev) {
+        if (store->versions[pos].epoch <= epoch) {
+            break;
+        }
+        oldest_newer = &store->versions[pos];
+    }
+    if (oldest_newer == NULL) {
+        if (current == NULL) {
+            return FALSE;
+        }
+        *p = *current;
+        return TRUE;
+    }
+    if (oldest_newer->op == WRITE_INSERT) {
+        return FALSE;
+    }
+    *p = oldest_newer->before;
+    return TRUE;
+}
+
+int version_build(const struct version_store *store, uint64_t epoch, const struct process *rows, int count, struct process **built, size_t *length) {
+    /* deleted rows come back - that is the most the copy can grow */
+    size_t newer = store->count;
+    size_t deletes = 0;
+    while (newer > store->first && store->versions[newer - 1].epoch > epoch) {
+        --newer;
+        if (store->versions[newer].op == WRITE_DELETE) {
+            ++deletes;
+        }
+    }
+    *length = count + deletes > 0 ? count + deletes : 1;
+    struct process *copy = region_alloc(*length * sizeof *copy);
+    if (copy == NULL) {
+        return -1;
+    }
+    (void) memcpy(copy, rows, count * sizeof *copy);
+    /* undo the writes newest first - every write only touched its row and for a delete the last row */
+    int n = count;
+    for (size_t pos = store->count; pos > newer; --pos) {
+        const struct version *v = &store->versions[pos - 1];
+        switch (v->op) {
+        case WRITE_INSERT:
+            /* the row got appended */
+            --n;
+            break;
+        case WRITE_UPDATE:
+            copy[v->row] = v->before;
+            break;
+        case WRITE_DELETE:
+            /* the last row took the place of the deleted one */
+            copy[n] = copy[v->row];
+            copy[v->row] = v->before;
+            ++n;
+            break;
+        }
+    }
+    *built = copy;
+    return n;
+}
+
+static int rebuild_heads(struct version_store *store) {
+    pid_index_free(&store->heads);
+    if (pid_index_init(&store->heads) == -1) {
+        return -1;
+    }
+    /* oldest first - the newest version of a pid is put last */
+    for (size_t pos = 0; pos < store->count; ++pos) {
+        if (pid_index_put(&store->heads, store->versions[pos].pid, pos) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int version_collect(struct version_store *store, uint64_t horizon) {
+    if (horizon > store->oldest) {
+        store->oldest = horizon;
+    }
+    while (store->first < store->count && store->versions[store->first].epoch <= horizon) {
+        ++store->first;
+    }
+    if (store->first == 0) {
+        return 0;
+    }
+    if (store->first == store->count) {
+        store->first = 0;
+        store->count = 0;
+        if (store->length > VERSION_INITIAL_LENGTH) {
+            /* a long reader is gone - give the memory back */
+            region_free(store->versions, store->length * sizeof *store->versions);
+            store->versions = NULL;
+            store->length = 0;
+        }
+        return store->heads.count > 0 ? rebuild_heads(store) : 0;
+    }
+    /* the dropped versions only get removed once they are half of the store - lookups stop at first until then */
+    if (store->first * 2 < store->count) {
+        return 0;
+    }
+    size_t kept = store->count - store->first;
+    (void) memmove(store->versions, &store->versions[store->first], kept * sizeof *store->versions);
+    for (size_t pos = 0; pos < kept; ++pos) {
+        int prev = store->versions[pos].prev;
+        store->versions[pos].prev = prev != -1 && (size_t) prev >= store->first ? prev - (int) store->first : -1;
+    }
+    store->first = 0;
+    store->count = kept;
+    return rebuild_heads(store);
+}
+
+size_t version_memory(const struct version_store *store) {
+    return store->length * sizeof *store->versions + pid_index_memory(&store->heads);
+}
+
+void version_free(struct version_store *store) {
+    if (store->versions != NULL) {
+        region_free(store->versions, store->length * sizeof *store->versions);
+        store->versions = NULL;
+    }
+    pid_index_free(&store->heads);
+    store->first = 0;
+    store->count = 0;
+    store->length = 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file procdb-version.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief old versions of the rows of procdb-server - they let readers see the table as it was at an older epoch
+ *
+ * @details every write that happens while a reader needs an older epoch appends the row as it was before the write (undo record). the versions of a pid are chained from the newest to the oldest, so a lookup as of an epoch only follows the chain of its pid. an update needs no version if the last version of its pid is newer than every epoch that is read - so a pid that gets updated all the time has at most one version per read epoch. the whole table as of an epoch gets built by undoing the newer writes on a copy of the rows. versions that no reader can see anymore get dropped from the front.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_VERSION_H
+#define PROCDB_VERSION_H
+
+#include "procdb.h"
+#include "procdb-index.h"
+
+/**
+ * @brief version is a row as it was before a write
+ */
+struct version {
+    /* epoch the write created - readers of an older epoch see before instead of the row */
+    uint64_t epoch;
+    /* WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE */
+    int op;
+    /* position of the row in the list of processes the write changed */
+    int row;
+    /* pid of the row - the chain of its versions starts at heads */
+    int pid;
+    /* position of the next older version of the same pid - -1 if there is none */
+    int prev;
+    /* the row before the write - not used for inserts */
+    struct process before;
+};
+
+/**
+ * @brief version_store is the list of versions, oldest first
+ */
+struct version_store {
+    struct version *versions;
+    /* position of the oldest version that is still needed, number of used and of allocated versions */
+    size_t first;
+    size_t count;
+    size_t length;
+    /* position of the newest version of every pid */
+    struct pid_index heads;
+    /* oldest epoch that can still be read */
+    uint64_t oldest;
+};
+
+/**
+ * @brief initializes an empty store
+ * @param store store to initialize
+ * @param epoch current epoch - the oldest one that can be read
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int version_init(struct version_store *store, uint64_t epoch);
+
+/**
+ * @brief adds the version of a row before a write
+ * @param store store to add to
+ * @param epoch epoch the write creates
+ * @param op WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE
+ * @param row position the write changes - for inserts the position the row gets appended at
+ * @param pid pid of the row
+ * @param before the row before the write - ignored for inserts
+ * @param newest newest epoch that is read - only epochs that are read when the write happens can be read later on
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int version_add(struct version_store *store, uint64_t epoch, int op, int row, int pid, const struct process *before, uint64_t newest);
+
+/**
+ * @brief looks up a row as it was at an epoch
+ * @param store store to search
+ * @param current the row now - NULL if the pid does not exist now
+ * @param pid pid of the row
+ * @param epoch epoch to look at - must have been read by someone since it was current and not be older than store->oldest
+ * @param p gets set to the row
+ * @return TRUE if the pid existed at the epoch - otherwise FALSE
+ */
+int version_lookup(const struct version_store *store, const struct process *current, int pid, uint64_t epoch, struct process *p);
+
+/**
+ * @brief builds a copy of the whole list of processes as it was at an epoch
+ * @param store store to use
+ * @param epoch epoch to build - must have been read by someone since it was current and not be older than store->oldest
+ * @param rows the list of processes now
+ * @param count number of rows now
+ * @param built gets set to the copy - allocated with region_alloc
+ * @param length gets set to the number of rows allocated for the copy
+ * @return number of rows at the epoch or -1 if memory could not be allocated
+ */
+int version_build(const struct version_store *store, uint64_t epoch, const struct process *rows, int count, struct process **built, size_t *length);
+
+/**
+ * @brief drops every version no reader of horizon or a newer epoch needs - horizon becomes the oldest epoch that can be read
+ * @param store store to clean up
+ * @param horizon oldest epoch that is still read
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int version_collect(struct version_store *store, uint64_t horizon);
+
+/**
+ * @brief returns the number of bytes the store uses
+ * @param store store to measure
+ * @return number of bytes
+ */
+size_t version_memory(const struct version_store *store);
+
+/**
+ * @brief frees the memory of a store
+ * @param store store to free
+ */
+void version_free(struct version_store *store);
+
+#endif
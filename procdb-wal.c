@@ -0,0 +1,519 @@
+/**
+ * @file procdb-wal.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief write-ahead log for the changes of the process-database of procdb-server
+ *
+ * @details segments are named wal-LSN.log after the lsn of their first record, snapshots snapshot-LSN.csv after the lsn of the last record they include (both 16 hex digits)
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb-wal.h"
+#include "procdb.h"
+#include <stddef.h>
+#include <dirent.h>
+
+/**
+ * @brief length of a segment or snapshot name without the directory
+ */
+#define WAL_NAME_SIZE (64)
+
+/**
+ * @brief table for calculating CRC-32 - filled by crc32_init
+ */
+static uint32_t crc32_table[256];
+
+/**
+ * @brief fills crc32_table
+ */
+static void crc32_init(void);
+
+/**
+ * @brief calculates the CRC-32 of a buffer
+ * @param crc CRC-32 of the data before buf or 0
+ * @param buf data
+ * @param length length of buf
+ * @return the CRC-32
+ */
+static uint32_t crc32_update(uint32_t crc, const void *buf, size_t length);
+
+/**
+ * @brief calculates the checksum of a record
+ * @param record fixed part of the record
+ * @param command command line of the record
+ * @return the checksum
+ */
+static uint32_t record_checksum(const struct wal_record *record, const char *command);
+
+/**
+ * @brief returns the number of bytes a record takes up in a segment
+ * @param length length of the command line of the record
+ * @return size including padding
+ */
+static size_t record_size(uint32_t length);
+
+/**
+ * @brief lists the files in a directory with a specific prefix and suffix and a lsn in between - sorted by lsn
+ * @param dir directory to list
+ * @param prefix prefix of the file names
+ * @param suffix suffix of the file names
+ * @param count gets set to the number of files found
+ * @return list of lsns (free it) or NULL if there were none or the directory could not be read
+ */
+static uint64_t *list_lsns(const char *dir, const char *prefix, const char *suffix, size_t *count);
+
+/**
+ * @brief compares two lsns - used for qsort
+ * @param a first lsn
+ * @param b second lsn
+ * @return <0, 0 or >0
+ */
+static int compare_lsn(const void *a, const void *b);
+
+/**
+ * @brief syncs a directory so new, renamed or removed entries are durable
+ * @param dir directory to sync
+ * @return 0 on success, -1 on error
+ */
+static int sync_dir(const char *dir);
+
+/**
+ * @brief closes the current segment and creates and preallocates the next one
+ * @param wal log the segment belongs to
+ * @param lsn lsn of the first record of the segment
+ * @param size size of the segment
+ * @return 0 on success, -1 on error
+ */
+static int open_segment(struct wal *wal, uint64_t lsn, off_t size);
+
+/**
+ * @brief writes a batch of records to the segments and syncs them
+ * @param wal log to write to
+ * @param batch records
+ * @param length length of batch
+ * @param rotate_lsn record that has to start a new segment or 0
+ * @return number of records written or -1 on error
+ */
+static long write_batch(struct wal *wal, const char *batch, size_t length, uint64_t rotate_lsn);
+
+/**
+ * @brief main function of the flusher thread - group commits everything appended while the previous sync was running
+ * @param arg the log
+ * @return NULL
+ */
+static void *flusher_main(void *arg);
+
+
+static void crc32_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *buf, size_t length) {
+    const unsigned char *p = buf;
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = crc32_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t record_checksum(const struct wal_record *record, const char *command) {
+    const char *fixed = (const char *) record;
+    uint32_t crc = crc32_update(0, fixed + offsetof(struct wal_record, length), sizeof *record - offsetof(struct wal_record, length));
+    return crc32_update(crc, command, record->length);
+}
+
+static size_t record_size(uint32_t length) {
+    return (sizeof(struct wal_record) + length + 7) & ~(size_t) 7;
+}
+
+static int compare_lsn(const void *a, const void *b) {
+    uint64_t la = *(const uint64_t *) a;
+    uint64_t lb = *(const uint64_t *) b;
+    return (la > lb) - (la < lb);
+}
+
+static uint64_t *list_lsns(const char *dir, const char *prefix, const char *suffix, size_t *count) {
+    *count = 0;
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return NULL;
+    }
+    uint64_t *lsns = NULL;
+    size_t capacity = 0;
+    size_t prefix_length = strlen(prefix);
+    size_t suffix_length = strlen(suffix);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length != prefix_length + 16 + suffix_length || strncmp(entry->d_name, prefix, prefix_length) != 0
+            || strcmp(entry->d_name + prefix_length + 16, suffix) != 0) {
+            continue;
+        }
+        char digits[17];
+        memcpy(digits, entry->d_name + prefix_length, 16);
+        digits[16] = '\0';
+        char *endptr = NULL;
+        uint64_t lsn = strtoull(digits, &endptr, 16);
+        if (*endptr != '\0') {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            uint64_t *grown = realloc(lsns, capacity * sizeof *lsns);
+            if (grown == NULL) {
+                break;
+            }
+            lsns = grown;
+        }
+        lsns[(*count)++] = lsn;
+    }
+    (void) closedir(d);
+    if (*count == 0) {
+        free(lsns);
+        return NULL;
+    }
+    qsort(lsns, *count, sizeof *lsns, compare_lsn);
+    return lsns;
+}
+
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    int result = fsync(fd);
+    (void) close(fd);
+    return result;
+}
+
+int wal_find_snapshot(const char *dir, uint64_t *lsn, char *path, size_t size) {
+    size_t count;
+    uint64_t *lsns = list_lsns(dir, "snapshot-", ".csv", &count);
+    if (lsns == NULL) {
+        return FALSE;
+    }
+    *lsn = lsns[count - 1];
+    (void) snprintf(path, size, "%s/snapshot-%016llx.csv", dir, (unsigned long long) *lsn);
+    free(lsns);
+    return TRUE;
+}
+
+long wal_replay(const char *dir, uint64_t after_lsn, void (*apply)(const struct wal_record *, const char *), uint64_t *last_lsn) {
+    crc32_init();
+    *last_lsn = after_lsn;
+    size_t count;
+    uint64_t *segments = list_lsns(dir, "wal-", ".log", &count);
+    long replayed = 0;
+    uint64_t last = 0;
+    int gap = FALSE;
+    for (size_t s = 0; s < count && !gap; ++s) {
+        char path[PATH_MAX];
+        (void) snprintf(path, sizeof path, "%s/wal-%016llx.log", dir, (unsigned long long) segments[s]);
+        int fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            free(segments);
+            return -1;
+        }
+        struct stat segment_stat;
+        if (fstat(fd, &segment_stat) == -1) {
+            (void) close(fd);
+            free(segments);
+            return -1;
+        }
+        char *data = NULL;
+        if (segment_stat.st_size > 0) {
+            data = mmap(NULL, segment_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                (void) close(fd);
+                free(segments);
+                return -1;
+            }
+        }
+        (void) close(fd);
+        size_t offset = 0;
+        size_t size = segment_stat.st_size;
+        while (offset + sizeof(struct wal_record) <= size) {
+            struct wal_record record;
+            memcpy(&record, data + offset, sizeof record);
+            /* the unused rest of a preallocated segment is all zeros */
+            if (record.lsn == 0 || offset + record_size(record.length) > size) {
+                break;
+            }
+            const char *command = data + offset + sizeof record;
+            /* a torn or corrupt record ends the segment - the next segment has to continue without a gap */
+            if (record_checksum(&record, command) != record.checksum) {
+                break;
+            }
+            if (record.lsn > after_lsn) {
+                uint64_t expected = (last > after_lsn ? last : after_lsn) + 1;
+                if (record.lsn != expected) {
+                    gap = TRUE;
+                    break;
+                }
+                apply(&record, command);
+                ++replayed;
+                *last_lsn = record.lsn;
+            }
+            last = record.lsn;
+            offset += record_size(record.length);
+        }
+        if (data != NULL) {
+            (void) munmap(data, size);
+        }
+    }
+    free(segments);
+    return replayed;
+}
+
+static int open_segment(struct wal *wal, uint64_t lsn, off_t size) {
+    if (wal->fd != -1) {
+        if (fdatasync(wal->fd) == -1 || close(wal->fd) == -1) {
+            wal->fd = -1;
+            return -1;
+        }
+        wal->fd = -1;
+    }
+    char path[PATH_MAX];
+    (void) snprintf(path, sizeof path, "%s/wal-%016llx.log", wal->dir, (unsigned long long) lsn);
+    wal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, PERMISSION);
+    if (wal->fd == -1) {
+        return -1;
+    }
+    /* preallocated segments do not change their size on writes - fdatasync does not have to flush the inode then */
+    int result = posix_fallocate(wal->fd, 0, size);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    if (sync_dir(wal->dir) == -1) {
+        return -1;
+    }
+    wal->segment_lsn = lsn;
+    wal->segment_size = size;
+    wal->segment_offset = 0;
+    return 0;
+}
+
+static long write_batch(struct wal *wal, const char *batch, size_t length, uint64_t rotate_lsn) {
+    size_t offset = 0;
+    long records = 0;
+    /* records that go to the same segment get written with one pwrite */
+    size_t run_start = 0;
+    off_t run_offset = wal->segment_offset;
+    while (offset < length) {
+        struct wal_record record;
+        memcpy(&record, batch + offset, sizeof record);
+        size_t size = record_size(record.length);
+        if (wal->fd == -1 || record.lsn == rotate_lsn || wal->segment_offset + (off_t) size > wal->segment_size) {
+            if (offset > run_start && pwrite(wal->fd, batch + run_start, offset - run_start, run_offset) != (ssize_t) (offset - run_start)) {
+                return -1;
+            }
+            if (open_segment(wal, record.lsn, size > WAL_SEGMENT_SIZE ? (off_t) size : WAL_SEGMENT_SIZE) == -1) {
+                return -1;
+            }
+            run_start = offset;
+            run_offset = 0;
+        }
+        wal->segment_offset += size;
+        offset += size;
+        ++records;
+    }
+    if (offset > run_start && pwrite(wal->fd, batch + run_start, offset - run_start, run_offset) != (ssize_t) (offset - run_start)) {
+        return -1;
+    }
+    if (wal->fd != -1 && fdatasync(wal->fd) == -1) {
+        return -1;
+    }
+    return records;
+}
+
+static void *flusher_main(void *arg) {
+    struct wal *wal = arg;
+    pthread_mutex_lock(&wal->lock);
+    while (TRUE) {
+        while (!wal->stop && wal->used[wal->current] == 0) {
+            pthread_cond_wait(&wal->appended, &wal->lock);
+        }
+        if (wal->used[wal->current] == 0) {
+            break;
+        }
+        /* take everything appended so far - new records go to the other buffer while this batch gets synced */
+        int batch = wal->current;
+        wal->current ^= 1;
+        uint64_t last = wal->next_lsn - 1;
+        uint64_t rotate_lsn = wal->rotate_lsn;
+        pthread_mutex_unlock(&wal->lock);
+
+        long records = wal->error == 0 ? write_batch(wal, wal->buffer[batch], wal->used[batch], rotate_lsn) : -1;
+
+        pthread_mutex_lock(&wal->lock);
+        if (records == -1) {
+            if (wal->error == 0) {
+                wal->error = errno != 0 ? errno : EIO;
+            }
+        } else {
+            wal->durable_lsn = last;
+            wal->syncs += 1;
+            wal->synced_records += records;
+        }
+        wal->used[batch] = 0;
+        pthread_cond_broadcast(&wal->synced);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+int wal_open(struct wal *wal, const char *dir, uint64_t next_lsn) {
+    crc32_init();
+    memset(wal, 0, sizeof *wal);
+    wal->fd = -1;
+    wal->next_lsn = next_lsn;
+    wal->durable_lsn = next_lsn - 1;
+    /* segments that start at or after next_lsn were not replayed - keep them out of the way of the new ones */
+    size_t count;
+    uint64_t *segments = list_lsns(dir, "wal-", ".log", &count);
+    for (size_t s = 0; s < count; ++s) {
+        if (segments[s] >= next_lsn) {
+            char path[PATH_MAX], corrupt[PATH_MAX + 16];
+            (void) snprintf(path, sizeof path, "%s/wal-%016llx.log", dir, (unsigned long long) segments[s]);
+            (void) snprintf(corrupt, sizeof corrupt, "%s.corrupt", path);
+            (void) rename(path, corrupt);
+        }
+    }
+    free(segments);
+    wal->dir = strdup(dir);
+    if (wal->dir == NULL) {
+        return -1;
+    }
+    if (pthread_mutex_init(&wal->lock, NULL) != 0 || pthread_cond_init(&wal->appended, NULL) != 0 || pthread_cond_init(&wal->synced, NULL) != 0) {
+        return -1;
+    }
+    int result = pthread_create(&wal->flusher, NULL, flusher_main, wal);
+    if (result != 0) {
+        errno = result;
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t wal_append(struct wal *wal, struct wal_record *record, const char *command) {
+    size_t size = record_size(record->length);
+    pthread_mutex_lock(&wal->lock);
+    if (wal->error != 0) {
+        errno = wal->error;
+        pthread_mutex_unlock(&wal->lock);
+        return 0;
+    }
+    int b = wal->current;
+    if (wal->used[b] + size > wal->capacity[b]) {
+        size_t capacity = wal->capacity[b] == 0 ? 64*1024 : wal->capacity[b];
+        while (wal->used[b] + size > capacity) {
+            capacity *= 2;
+        }
+        char *grown = realloc(wal->buffer[b], capacity);
+        if (grown == NULL) {
+            pthread_mutex_unlock(&wal->lock);
+            return 0;
+        }
+        wal->buffer[b] = grown;
+        wal->capacity[b] = capacity;
+    }
+    record->lsn = wal->next_lsn++;
+    record->checksum = record_checksum(record, command);
+    char *dest = wal->buffer[b] + wal->used[b];
+    memcpy(dest, record, sizeof *record);
+    memcpy(dest + sizeof *record, command, record->length);
+    memset(dest + sizeof *record + record->length, 0, size - sizeof *record - record->length);
+    wal->used[b] += size;
+    pthread_cond_signal(&wal->appended);
+    pthread_mutex_unlock(&wal->lock);
+    return record->lsn;
+}
+
+int wal_wait(struct wal *wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn < lsn && wal->error == 0) {
+        pthread_cond_wait(&wal->synced, &wal->lock);
+    }
+    int result = wal->durable_lsn >= lsn ? 0 : -1;
+    if (result == -1) {
+        errno = wal->error;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+uint64_t wal_rotate(struct wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    wal->rotate_lsn = wal->next_lsn;
+    uint64_t last = wal->next_lsn - 1;
+    pthread_mutex_unlock(&wal->lock);
+    return last;
+}
+
+int wal_write_snapshot(const char *dir, uint64_t lsn, int (*write_rows)(FILE *)) {
+    char path[PATH_MAX], tmp_path[PATH_MAX + 8];
+    (void) snprintf(path, sizeof path, "%s/snapshot-%016llx.csv", dir, (unsigned long long) lsn);
+    (void) snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    if (write_rows(file) == -1 || fflush(file) == EOF || fsync(fileno(file)) == -1) {
+        (void) fclose(file);
+        (void) unlink(tmp_path);
+        return -1;
+    }
+    if (fclose(file) == EOF || rename(tmp_path, path) == -1) {
+        (void) unlink(tmp_path);
+        return -1;
+    }
+    return sync_dir(dir);
+}
+
+void wal_remove_obsolete(const char *dir, uint64_t snapshot_lsn) {
+    char path[PATH_MAX];
+    size_t count;
+    uint64_t *segments = list_lsns(dir, "wal-", ".log", &count);
+    /* a segment is obsolete if the next one starts right after the snapshot or before */
+    for (size_t s = 0; s + 1 < count && segments[s + 1] <= snapshot_lsn + 1; ++s) {
+        (void) snprintf(path, sizeof path, "%s/wal-%016llx.log", dir, (unsigned long long) segments[s]);
+        (void) unlink(path);
+    }
+    free(segments);
+    uint64_t *snapshots = list_lsns(dir, "snapshot-", ".csv", &count);
+    for (size_t s = 0; s < count && snapshots[s] < snapshot_lsn; ++s) {
+        (void) snprintf(path, sizeof path, "%s/snapshot-%016llx.csv", dir, (unsigned long long) snapshots[s]);
+        (void) unlink(path);
+    }
+    free(snapshots);
+    (void) sync_dir(dir);
+}
+
+void wal_close(struct wal *wal) {
+    if (wal->dir == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&wal->lock);
+    wal->stop = TRUE;
+    pthread_cond_signal(&wal->appended);
+    pthread_mutex_unlock(&wal->lock);
+    (void) pthread_join(wal->flusher, NULL);
+    if (wal->fd != -1) {
+        (void) close(wal->fd);
+    }
+    free(wal->buffer[0]);
+    free(wal->buffer[1]);
+    free(wal->dir);
+    wal->dir = NULL;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file procdb-wal.h
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief write-ahead log for the changes of the process-database of procdb-server
+ *
+ * @details every insert, update and delete gets appended as a checksummed record to a log of preallocated segment files. a flusher thread writes everything that got appended while the previous fdatasync was running with one single fdatasync (group commit). on startup the segments get replayed on top of the newest snapshot. snapshots get written in the background and make the segments before them obsolete.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#ifndef PROCDB_WAL_H
+#define PROCDB_WAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * @brief size segment files get preallocated with - a record that is bigger gets a segment of its own
+ */
+#define WAL_SEGMENT_SIZE (16*1024*1024)
+
+/**
+ * @brief wal_record is the fixed part of a record - it gets followed by length bytes of the command line and padded to 8 bytes
+ */
+struct wal_record {
+    /* CRC-32 of everything after this field including the command line */
+    uint32_t checksum;
+    /* length of the command line that follows */
+    uint32_t length;
+    /* log sequence number - records are numbered without gaps starting at 1 */
+    uint64_t lsn;
+    /* WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE */
+    int32_t op;
+    int32_t pid;
+    /* field that gets updated - 0 - cpu, 1 - mem, 2 - time, 3 - command */
+    int32_t field;
+    /* cpu, mem and time of an insert - for an update only values[field] gets used */
+    int32_t values[3];
+};
+
+/**
+ * @brief wal is an open write-ahead log
+ */
+struct wal {
+    /* directory of the segments and snapshots */
+    char *dir;
+    /* file descriptor, first lsn, size and write position of the current segment - only used by the flusher */
+    int fd;
+    uint64_t segment_lsn;
+    off_t segment_size;
+    off_t segment_offset;
+    /* records that got appended but not written yet - the flusher swaps the two buffers */
+    char *buffer[2];
+    size_t used[2];
+    size_t capacity[2];
+    int current;
+    /* lsn of the next record and lsn up to which everything is synced */
+    uint64_t next_lsn;
+    uint64_t durable_lsn;
+    /* the record with this lsn starts a new segment - 0 if no rotation is pending */
+    uint64_t rotate_lsn;
+    /* number of fdatasync calls and of records synced by them */
+    uint64_t syncs;
+    uint64_t synced_records;
+    /* errno of the first failed write - once set everything fails */
+    int error;
+    int stop;
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t appended;
+    pthread_cond_t synced;
+};
+
+/**
+ * @brief searches the newest snapshot in a directory
+ * @param dir directory to search
+ * @param lsn gets set to the lsn the snapshot includes
+ * @param path gets set to the path of the snapshot
+ * @param size size of path
+ * @return TRUE if a snapshot was found - otherwise FALSE
+ */
+int wal_find_snapshot(const char *dir, uint64_t *lsn, char *path, size_t size);
+
+/**
+ * @brief replays the segments in a directory - stops at the first record that is torn, has a wrong checksum or leaves a gap
+ * @param dir directory of the segments
+ * @param after_lsn records up to this lsn are already part of the snapshot and get skipped
+ * @param apply gets called for every record after after_lsn with the record and its command line
+ * @param last_lsn gets set to the lsn of the last valid record (at least after_lsn)
+ * @return number of replayed records or -1 if the segments could not be read
+ */
+long wal_replay(const char *dir, uint64_t after_lsn, void (*apply)(const struct wal_record *, const char *), uint64_t *last_lsn);
+
+/**
+ * @brief opens the log for appending - the first record gets written to a new segment
+ * @param wal log to open
+ * @param dir directory of the segments
+ * @param next_lsn lsn of the first record
+ * @return 0 on success, -1 on error (errno is set)
+ */
+int wal_open(struct wal *wal, const char *dir, uint64_t next_lsn);
+
+/**
+ * @brief appends a record - it is not durable before wal_wait returned for its lsn
+ * @param wal log to append to
+ * @param record record to append - lsn and checksum get set
+ * @param command command line of the record (length bytes)
+ * @return lsn of the record or 0 on error
+ */
+uint64_t wal_append(struct wal *wal, struct wal_record *record, const char *command);
+
+/**
+ * @brief waits until a record and all before it are durable
+ * @param wal log to wait for
+ * @param lsn lsn of the record
+ * @return 0 on success, -1 if the log could not be written (errno is set)
+ */
+int wal_wait(struct wal *wal, uint64_t lsn);
+
+/**
+ * @brief lets the next record start a new segment so every older segment only has records up to the current lsn
+ * @param wal log to rotate
+ * @return lsn of the last record that stays in the older segments
+ */
+uint64_t wal_rotate(struct wal *wal);
+
+/**
+ * @brief writes a snapshot file atomically - called from the snapshot process
+ * @param dir directory of the snapshots
+ * @param lsn lsn the snapshot includes
+ * @param write_rows writes the rows in the format of the input-file to the file
+ * @return 0 on success, -1 on error
+ */
+int wal_write_snapshot(const char *dir, uint64_t lsn, int (*write_rows)(FILE *));
+
+/**
+ * @brief removes every segment and snapshot that is made obsolete by a snapshot
+ * @param dir directory of the segments and snapshots
+ * @param snapshot_lsn lsn of the snapshot
+ */
+void wal_remove_obsolete(const char *dir, uint64_t snapshot_lsn);
+
+/**
+ * @brief writes everything that is still buffered, stops the flusher and closes the log
+ * @param wal log to close
+ */
+void wal_close(struct wal *wal);
+
+#endif
@@ -9,6 +9,9 @@
  * 
  */
 
+#ifndef PROCDB_H
+#define PROCDB_H
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -20,8 +23,12 @@
 #include <sys/wait.h>
 #include <limits.h>
 #include <semaphore.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
 #include <fcntl.h> 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #ifdef ENDEBUG
@@ -56,37 +63,340 @@
 #define PERMISSION (0600)
 
 /*
- * @brief location of the interaction_started semaphore
+ * @brief location of the server-control shared memory for clients to connect to
  */ 
-#define SEM_INTERACTION_STARTED "/procdb_interaction_started_sem"
+#define SHM_SERVER "/procdb_server_control_shm"
 
 /*
- * @brief location of the client semaphore
+ * @brief location of the shared string heap the server publishes the command lines in
  */ 
-#define SEM_CLIENT "/procdb_client"
+#define SHM_STRING_HEAP "/procdb_server_string_heap"
 
- /*
- * @brief location of the server semaphore
+/*
+ * @brief string_heap is the header of the shared string heap - clients map it read-only and read command lines in place
  */ 
-#define SEM_SERVER "/procdb_server"
+struct string_heap {
+    /* number of bytes usable in data - clients have to remap the heap if an offset points beyond what they mapped */
+    size_t capacity;
+    /* number of bytes already used in data - new strings get appended at this offset */
+    size_t used;
+    /* the strings themselves - they are not null terminated, every string is identified by offset and length */
+    char data[];
+};
 
 /*
- * @brief location of the server-control shared memory for clients to connect to
+ * @brief time in ms a command line a client got stays where it is after nobody can read it any more - replaced and deleted command lines get reused after that
  */ 
-#define SHM_SERVER "/procdb_server_control_shm"
+#define HEAP_GRACE_MS (LEASE_TIMEOUT_MS)
 
 /*
- * @brief shm_struct is the struct that is the structure for the shared memory space
+ * @brief number of fields that can be aggregated - cpu, mem, time
  */ 
-struct shm_struct {
-    /* at first set to -1, the client sets it to either -2 if pid_cmd should be used or to the numeric value of the proccess id */
+#define STATS_FIELDS (3)
+
+/*
+ * @brief number of aggregates - min, max, sum, avg
+ */ 
+#define STATS_AGGREGATES (4)
+
+/*
+ * @brief max length of the command line a client can send with an insert or update
+ */ 
+#define REQUEST_DATA_SIZE (64*1024)
+
+/*
+ * @brief write operations - insert a process, update one field of a process, delete a process
+ */ 
+#define WRITE_INSERT (1)
+#define WRITE_UPDATE (2)
+#define WRITE_DELETE (3)
+
+/*
+ * @brief status of a write operation returned by the server
+ */ 
+#define STATUS_OK (0)
+#define STATUS_NOT_FOUND (1)
+#define STATUS_EXISTS (2)
+#define STATUS_READ_ONLY (3)
+#define STATUS_INVALID (4)
+
+/*
+ * @brief status of a read whose epoch is neither the current one nor pinned
+ */ 
+#define STATUS_NO_EPOCH (5)
+
+/*
+ * @brief status of a request whose seal did not match (see request_seal) - a client that lost the slot wrote into it, nothing was done and the request has to be handed over again
+ */ 
+#define STATUS_OVERWRITTEN (6)
+
+/*
+ * @brief what a distinct request counts (info of the request) - command lines or pids
+ */ 
+#define DISTINCT_COMMAND (3)
+#define DISTINCT_PID (4)
+
+/*
+ * @brief time windows of distinct requests - the server keeps one sketch per window for the last DISTINCT_WINDOWS windows of DISTINCT_WINDOW_SECONDS
+ */ 
+#define DISTINCT_WINDOWS (60)
+#define DISTINCT_WINDOW_SECONDS (60)
+
+/*
+ * @brief most rows a table can have for an exact distinct count - bigger tables only get estimated
+ */ 
+#define DISTINCT_EXACT_ROWS (1 << 18)
+
+/*
+ * @brief number of request slots - that many clients can have a request in flight at the same time
+ */ 
+#define SLOT_COUNT (16)
+
+/*
+ * @brief states of a request slot - free, claimed by a client that writes its request, request ready for the server, response ready for the client
+ */ 
+#define SLOT_FREE (0)
+#define SLOT_CLAIMED (1)
+#define SLOT_REQUEST (2)
+#define SLOT_RESPONSE (3)
+
+/*
+ * @brief lease word of a request slot - generation (bumped every time the slot gets claimed or reclaimed), state and pid of the client (0 if free)
+ */ 
+#define LEASE(generation, state, pid) (((uint64_t) (generation) << 40) | ((uint64_t) (state) << 32) | (uint32_t) (pid))
+#define LEASE_GENERATION(lease) ((lease) >> 40)
+#define LEASE_STATE(lease) ((int) (((lease) >> 32) & 0xff))
+#define LEASE_PID(lease) ((pid_t) ((lease) & 0xffffffff))
+
+/*
+ * @brief time a client has to write its request or to read its response before the server reclaims the slot
+ */ 
+#define LEASE_TIMEOUT_MS (1000)
+
+/*
+ * @brief longest time the server and the clients block without checking for dead or stalled peers
+ */ 
+#define WAIT_INTERVAL_MS (100)
+
+/*
+ * @brief adaptive backoff of busy polling - number of plain spins, of spins with a pause instruction and of sched_yield calls before the waiter parks on its semaphore
+ */ 
+#define POLL_SPINS (256)
+#define POLL_PAUSES (4096)
+#define POLL_YIELDS (64)
+
+/*
+ * @brief tells the cpu that this is a spin loop - saves power and lets the other hyperthread of the core run
+ */ 
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define CPU_RELAX() do { } while (0)
+#endif
+
+/*
+ * @brief request_slot is one request and its response - a client owns it while its pid is in the lease word
+ */ 
+struct request_slot {
+    /* see LEASE - only changed with compare and swap so a reclaimed client can not touch the slot anymore */
+    uint64_t lease;
+    /* gets posted by the server as soon as the response is ready - but only if client_parked is set */
+    sem_t response;
+    /* TRUE if the client sleeps on response - the server takes it back with an exchange before it posts, so there is exactly one post per park */
+    int client_parked;
+    /* the client sets it to either -2 if pid_cmd should be used, to -3 for a stats request, to -4 for a watch, to -5 for the next page of a scan, to -6 to pin an epoch, to -7 for a distinct count or to the numeric value of the proccess id */
     int pid;
-    /* at first set to -1, if the client sets pid to -2 this value gets used - if set to 0 it means min, to 1 max, to 2 sum, to 3 avg */
+    /* if the client sets pid to -2 this value gets used - if set to 0 it means min, to 1 max, to 2 sum, to 3 avg */
     int pid_cmd;
-    /* at first set to -1, represents what information the client wants, 0 - cpu, 1 - mem, 2 - time, 3 - command */
+    /* represents what information the client wants, 0 - cpu, 1 - mem, 2 - time, 3 - command */
     int info;
-    /* at first set to NULL, this is what the server returns to the client  */
-    char value[LINE_SIZE];
-    /* at first set to -1, this is what the server returns to the client when returning a numeric value - if this gets returned if value is set to NULL */
+    /* only used for stats requests - bitmask of the aggregates (1 - min, 2 - max, 4 - sum, 8 - avg) and of the fields (1 - cpu, 2 - mem, 4 - time) */
+    int stats_aggregates;
+    int stats_fields;
+    /* results of a stats request - indexed by field and aggregate, everything that was not asked for is 0 */
+    long long stats[STATS_FIELDS][STATS_AGGREGATES];
+    /* 0 for reads, WRITE_INSERT, WRITE_UPDATE or WRITE_DELETE for a write request to the process pid - info is the field of an update */
+    int write_op;
+    /* cpu, mem and time of an insert - for an update only write_values[info] gets used */
+    int write_values[STATS_FIELDS];
+    /* command line of an insert or of an update of the command */
+    size_t request_length;
+    char request_data[REQUEST_DATA_SIZE];
+    /* only used for watches - pid of the watched process (-1 for all), WATCH_ABOVE or WATCH_BELOW and the threshold - info is the field */
+    int watch_pid;
+    int watch_condition;
+    int watch_threshold;
+    /* only used for scans - cursor of the scan (-1 to open one, gets set by the server), SCAN_BINARY or SCAN_CSV */
+    int cursor;
+    int format;
+    /* number of rows and bytes in the page of the cursor - 0 rows at the end of the scan, the cursor is free again afterwards */
+    size_t page_rows;
+    size_t page_bytes;
+    /* only used for distinct counts - TRUE to count exactly instead of estimating, number of the last windows to count in (0 for the whole table) - info is DISTINCT_COMMAND or DISTINCT_PID */
+    int distinct_exact;
+    int distinct_windows;
+    /* epoch a read sees - 0 for the current one. for a pin the epoch to pin (0 for the current one), the server sets it to the pinned epoch */
+    uint64_t epoch;
+    /* request_seal of the request and its SLOT_REQUEST lease word - written by the client after the request, the server only answers a request whose seal matches */
+    uint64_t seal;
+    /* STATUS_OK or why a request failed */
+    int status;
+    /* offset of the returned string in the data of the string heap */
+    size_t value_offset;
+    /* length of the returned string in the string heap - 0 if no string gets returned */
+    size_t value_length;
+    /* this is what the server returns to the client when returning a numeric value - -1 if the process was not found, for a watch the index of the watch or -1 if all are taken, for a scan 0 or -1 if no cursor is left, for a pin the index of the pin or -1 if all are taken, for a distinct count the count or -1 if the request was invalid */
     int value_d;
-};
\ No newline at end of file
+};
+
+/*
+ * @brief seal of a request - a hash of everything the server reads from the slot and of the lease word the request gets handed over with. a stalled client whose slot got reclaimed may still write into the slot, but it seals with an older generation, so the server sees that the request of the new owner got overwritten
+ * @param slot slot with the request - the server passes its own copy
+ * @param lease lease word of the slot in state SLOT_REQUEST
+ * @return the seal
+ */
+static inline uint64_t request_seal(const struct request_slot *slot, uint64_t lease) {
+    const long long values[] = {slot->write_op, slot->pid, slot->pid_cmd, slot->info, slot->stats_aggregates, slot->stats_fields,
+        slot->write_values[0], slot->write_values[1], slot->write_values[2], slot->watch_pid, slot->watch_condition, slot->watch_threshold,
+        slot->cursor, slot->format, slot->distinct_exact, slot->distinct_windows, (long long) slot->epoch, (long long) slot->request_length};
+    /* FNV-1a over the values and the command line */
+    uint64_t h = 0xcbf29ce484222325ULL ^ lease;
+    for (size_t i = 0; i < COUNT_OF(values); ++i) {
+        h = (h ^ (uint64_t) values[i]) * 0x100000001b3ULL;
+    }
+    size_t length = slot->request_length > REQUEST_DATA_SIZE ? REQUEST_DATA_SIZE : slot->request_length;
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ (unsigned char) slot->request_data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * @brief number of watches - that many clients can wait for changes at the same time
+ */ 
+#define WATCH_COUNT (16)
+
+/*
+ * @brief number of events a watch can queue before the server drops new ones - must be a power of 2
+ */ 
+#define WATCH_EVENTS (256)
+
+/*
+ * @brief conditions of a watch - value > threshold or value < threshold
+ */ 
+#define WATCH_ABOVE (1)
+#define WATCH_BELOW (2)
+
+/*
+ * @brief watch_event is a row that started to fulfil the condition of a watch
+ */ 
+struct watch_event {
+    int pid;
+    int field;
+    int value;
+    /* CLOCK_MONOTONIC time in ns the write got applied */
+    long long time;
+};
+
+/*
+ * @brief watch is a subscription of a client - the server queues every row that starts to fulfil the condition (edge triggered)
+ */ 
+struct watch {
+    /* pid of the client the watch belongs to - 0 if free. the server sets it when it hands the watch out, the client sets it back to 0 */
+    pid_t owner;
+    /* pid of the watched process or -1 for all processes */
+    int pid;
+    /* 0 - cpu, 1 - mem, 2 - time */
+    int field;
+    /* WATCH_ABOVE or WATCH_BELOW */
+    int condition;
+    int threshold;
+    /* gets posted by the server when new events got queued - but only if client_parked is set */
+    sem_t notify;
+    /* TRUE if the client sleeps on notify - the server takes it back with an exchange before it posts */
+    int client_parked;
+    /* number of events queued - only written by the server */
+    uint64_t head;
+    /* number of events read - only written by the client */
+    uint64_t tail;
+    /* number of events that got dropped because the queue was full */
+    uint64_t dropped;
+    struct watch_event events[WATCH_EVENTS];
+};
+
+/*
+ * @brief number of cursors - that many scans can run at the same time
+ */ 
+#define SCAN_CURSORS (4)
+
+/*
+ * @brief size of the page a cursor returns the rows in
+ */ 
+#define SCAN_PAGE_SIZE (1024*1024)
+
+/*
+ * @brief formats of a scan page - an array of struct process (the command lines stay in the string heap) or lines like in the input-file
+ */ 
+#define SCAN_BINARY (0)
+#define SCAN_CSV (1)
+
+/*
+ * @brief scan_cursor is the page of a scan - the server fills it for every request of the client that owns the cursor
+ */ 
+struct scan_cursor {
+    /* pid of the client the cursor belongs to - 0 if free. only written by the server */
+    pid_t owner;
+    /* SCAN_BINARY - struct process, SCAN_CSV - text */
+    char page[SCAN_PAGE_SIZE];
+};
+
+/*
+ * @brief number of pins - that many clients can read an older epoch at the same time
+ */ 
+#define EPOCH_PINS (16)
+
+/*
+ * @brief epoch_pin keeps the versions of an epoch - the server drops versions that no pin (and no cursor) needs anymore
+ */ 
+struct epoch_pin {
+    /* pid of the client the pin belongs to - 0 if free. the server sets it when it hands the pin out, the client sets it back to 0 */
+    pid_t owner;
+    /* the pinned epoch */
+    uint64_t epoch;
+};
+
+/*
+ * @brief shm_struct is the struct that is the structure for the shared memory space
+ */ 
+struct shm_struct {
+    /* 0 until the server has set up the semaphores - then the pid of the server */
+    pid_t server_pid;
+    /* gets posted by the clients for every request they hand over - but only if server_parked is set */
+    sem_t work;
+    /* TRUE if the server sleeps on work - always TRUE unless the server busy polls (option -P) */
+    int server_parked;
+    struct request_slot slots[SLOT_COUNT];
+    struct watch watches[WATCH_COUNT];
+    struct scan_cursor cursors[SCAN_CURSORS];
+    /* number of writes applied since the server started (starting at 1) - every write creates a new epoch */
+    uint64_t epoch;
+    struct epoch_pin pins[EPOCH_PINS];
+};
+
+/**
+ * @brief struct that represents a entry in the input file
+ */
+struct process {
+    int pid;
+    int p_cpu;
+    int p_mem;
+    int p_time;
+    /* offset of the command line in the data of the string heap */
+    size_t p_command_offset;
+    /* length of the command line in the string heap */
+    size_t p_command_length;
+};
+
+#endif
\ No newline at end of file
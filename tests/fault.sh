@@ -0,0 +1,110 @@
+#!/bin/bash
+##
+## @file fault.sh
+##
+## @brief fault injection test of the request slots - clients get killed and stopped in the middle of their requests, the others have to keep getting answers
+##
+## @details run by make test from the top directory. the server uses the well-known shared memory names, so no other procdb-server may run.
+##
+## @author Ulrike Schaefer 1327450
+##
+## @date 18.10.2026
+##
+
+cd "$(dirname "$0")/.." || exit 1
+if pgrep -x procdb-server > /dev/null; then
+    echo "fault.sh: a procdb-server is already running"
+    exit 1
+fi
+
+dir=$(mktemp -d)
+clients=()
+server=
+cleanup() {
+    kill -KILL "${clients[@]}" 2> /dev/null
+    [ -n "$server" ] && kill -INT "$server" 2> /dev/null
+    wait 2> /dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+for pid in $(seq 1 1000); do
+    echo "$pid,$((pid % 100)),$((pid % 50)),$pid,/usr/bin/cmd$pid --flag x"
+done > "$dir/in.csv"
+# two rows with the same pid - lookups return the first one
+echo "2001,10,1,1,/usr/bin/dup first" >> "$dir/in.csv"
+echo "2001,20,1,1,/usr/bin/dup second" >> "$dir/in.csv"
+./procdb-server "$dir/in.csv" > "$dir/server.log" 2>&1 &
+server=$!
+sleep 0.5
+
+failed=0
+
+# served NAME - a fresh client has to get the right answer within a few lease timeouts
+served() {
+    local answer
+    answer=$(echo '42 cpu' | timeout 10 ./procdb-client 2> /dev/null | head -1)
+    if [ "$answer" = "42 42" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1 - got '$answer'"
+        failed=1
+    fi
+}
+
+served "before any fault"
+
+# clients that get killed at random points of their requests - their slots belong to dead pids
+for n in $(seq 1 24); do
+    ./procdb-client -b 100000000 <<< '7 cpu' > /dev/null 2>&1 &
+    victim=$!
+    sleep 0.0$((RANDOM % 9 + 1))
+    kill -KILL "$victim"
+    wait "$victim" 2> /dev/null
+done
+served "after killing 24 clients"
+
+# more stopped clients than slots - the server has to reclaim the slots of the stalled ones
+clients=()
+for n in $(seq 1 20); do
+    ./procdb-client -b 100000000 <<< 'update 7 cpu 3' > /dev/null 2>&1 &
+    clients+=($!)
+done
+sleep 0.3
+kill -STOP "${clients[@]}"
+served "with 20 stopped clients"
+kill -CONT "${clients[@]}"
+sleep 0.3
+kill -KILL "${clients[@]}"
+wait "${clients[@]}" 2> /dev/null
+clients=()
+served "after the stopped clients woke up"
+
+# a client that stops right after its claim and writes into the slot of the next owner
+if ./tests/procdb-fault 42 > "$dir/fault.log" 2>&1; then
+    sed 's/^/ok   /' "$dir/fault.log"
+else
+    sed 's/^/FAIL /' "$dir/fault.log"
+    failed=1
+fi
+served "after the stalled client"
+
+# a reader pinned before a delete of a duplicate pid and an update of the row that takes over must not see the update
+( printf 'begin\nsum cpu\n'; sleep 1; printf 'sum cpu\nend\n' ) | timeout 10 ./procdb-client > "$dir/pin.log" 2>&1 &
+pinned=$!
+sleep 0.5
+printf 'delete 2001\nupdate 2001 cpu 999\n' | timeout 10 ./procdb-client > /dev/null 2>&1
+wait "$pinned"
+sums=$(grep '^- ' "$dir/pin.log" | uniq | wc -l)
+if [ "$(grep -c '^- ' "$dir/pin.log")" = 2 ] && [ "$sums" = 1 ]; then
+    echo "ok   pinned read does not see the update of a duplicate pid"
+else
+    echo "FAIL pinned read sees the update of a duplicate pid - got $(grep '^- ' "$dir/pin.log" | tr '\n' ' ')"
+    failed=1
+fi
+
+if ! kill -0 "$server" 2> /dev/null; then
+    echo "FAIL the server died"
+    failed=1
+fi
+exit $failed
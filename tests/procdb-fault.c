@@ -0,0 +1,334 @@
+/**
+ * @file procdb-fault.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief fault injection for the request slots of procdb-server - plays a client that stops in the middle of a request
+ *
+ * @details talks to the server through the shared memory directly, like a client that does not use libprocdb. first it sends reads with fields and aggregates that do not exist - the server has to answer them with STATUS_INVALID and libprocdb must not send them at all. it claims a slot and stops right after the compare and swap - the server has to reclaim the slot. then it claims the same slot again as the next owner, writes a read and lets the stalled client wake up and write a delete over it before the read gets handed over - the server must not serve the mixed request. usage: procdb-fault pid (pid has to be in the table)
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include "procdb.h"
+#include "libprocdb.h"
+
+/**
+ * @brief longest time to wait for the server in ms
+ */
+#define FAULT_TIMEOUT_MS (5000)
+
+/**
+ * @brief Name of the program
+ */
+static const char *progname = "procdb-fault";
+
+/**
+ * @brief the shared memory of the server
+ */
+static struct shm_struct *shm = NULL;
+
+/**
+ * @brief terminate program on program error
+ * @param exitcode exit code
+ * @param fmt format string
+ */
+static void bail_out(int exitcode, const char *fmt, ...);
+
+/**
+ * @brief returns the current CLOCK_MONOTONIC time
+ * @return time in ms
+ */
+static long long monotonic_ms(void);
+
+/**
+ * @brief claims a request slot
+ * @param index slot to claim or -1 for any free one - gets set to the claimed slot
+ * @return lease word of the claimed slot
+ */
+static uint64_t claim(int *index);
+
+/**
+ * @brief waits until the lease word of a slot is not the given one anymore
+ * @param slot slot to watch
+ * @param lease lease word to wait for a change of
+ * @return the new lease word
+ */
+static uint64_t wait_change(struct request_slot *slot, uint64_t lease);
+
+/**
+ * @brief writes a read of the cpu of a process into a claimed slot and seals it
+ * @param slot claimed slot
+ * @param lease lease word of the claimed slot
+ * @param pid process to read
+ */
+static void write_read(struct request_slot *slot, uint64_t lease, int pid);
+
+/**
+ * @brief hands a request over and waits for the response
+ * @param slot slot with the request
+ * @param lease lease word of the claimed slot
+ * @param value gets set to the numeric value of the response
+ * @return status of the response - the slot is free again afterwards
+ */
+static int serve(struct request_slot *slot, uint64_t lease, int *value);
+
+/**
+ * @brief sends a read through the shared memory
+ * @param pid pid of the request - -2 for an aggregate, -3 for stats
+ * @param pid_cmd aggregate of an aggregate request
+ * @param info field of the read
+ * @param aggregates bitmask of the aggregates of a stats request
+ * @param fields bitmask of the fields of a stats request
+ * @return status of the response
+ */
+static int raw_read(int pid, int pid_cmd, int info, int aggregates, int fields);
+
+/**
+ * @brief sends reads with fields and aggregates that do not exist - through the shared memory and through libprocdb
+ * @param pid process to read
+ */
+static void invalid_round(int pid);
+
+/**
+ * @brief a stalled client claims a slot, gets reclaimed and writes its delete into the read of the next owner
+ * @param pid process to read and to delete
+ * @param seal TRUE if the stalled client gets as far as sealing its delete
+ */
+static void stale_round(int pid, int seal);
+
+
+static void bail_out(int exitcode, const char *fmt, ...) {
+    va_list ap;
+
+    (void) fprintf(stderr, "%s: ", progname);
+    if (fmt != NULL) {
+        va_start(ap, fmt);
+        (void) vfprintf(stderr, fmt, ap);
+        va_end(ap);
+    }
+    if (errno != 0) {
+        (void) fprintf(stderr, ": %s", strerror(errno));
+    }
+    (void) fprintf(stderr, "\n");
+    exit(exitcode);
+}
+
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000LL;
+}
+
+static uint64_t claim(int *index) {
+    long long deadline = monotonic_ms() + FAULT_TIMEOUT_MS;
+    while (monotonic_ms() < deadline) {
+        for (int i = 0; i < SLOT_COUNT; ++i) {
+            if (*index != -1 && i != *index) {
+                continue;
+            }
+            struct request_slot *slot = &shm->slots[i];
+            uint64_t current = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+            if (LEASE_PID(current) != 0) {
+                continue;
+            }
+            uint64_t claimed = LEASE(LEASE_GENERATION(current) + 1, SLOT_CLAIMED, getpid());
+            if (__atomic_compare_exchange_n(&slot->lease, &current, claimed, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                *index = i;
+                return claimed;
+            }
+        }
+        struct timespec pause = {0, 100000};
+        (void) nanosleep(&pause, NULL);
+    }
+    errno = 0;
+    bail_out(EXIT_FAILURE, "no free request slot");
+    return 0;
+}
+
+static uint64_t wait_change(struct request_slot *slot, uint64_t lease) {
+    long long deadline = monotonic_ms() + FAULT_TIMEOUT_MS;
+    while (monotonic_ms() < deadline) {
+        uint64_t current = __atomic_load_n(&slot->lease, __ATOMIC_ACQUIRE);
+        if (current != lease) {
+            return current;
+        }
+        struct timespec pause = {0, 100000};
+        (void) nanosleep(&pause, NULL);
+    }
+    errno = 0;
+    bail_out(EXIT_FAILURE, "lease word %llx did not change within %d ms", (unsigned long long) lease, FAULT_TIMEOUT_MS);
+    return 0;
+}
+
+static void write_read(struct request_slot *slot, uint64_t lease, int pid) {
+    slot->write_op = 0;
+    slot->request_length = 0;
+    slot->pid_cmd = -1;
+    slot->info = 0;
+    slot->pid = pid;
+    slot->epoch = 0;
+    slot->client_parked = FALSE;
+    slot->seal = request_seal(slot, LEASE(LEASE_GENERATION(lease), SLOT_REQUEST, LEASE_PID(lease)));
+}
+
+static int serve(struct request_slot *slot, uint64_t lease, int *value) {
+    uint64_t request = LEASE(LEASE_GENERATION(lease), SLOT_REQUEST, LEASE_PID(lease));
+    if (!__atomic_compare_exchange_n(&slot->lease, &lease, request, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "the owner of the slot could not hand its request over");
+    }
+    if (__atomic_load_n(&shm->server_parked, __ATOMIC_SEQ_CST) && sem_post(&shm->work) == -1) {
+        bail_out(EXIT_FAILURE, "sem_post failed");
+    }
+    uint64_t response = LEASE(LEASE_GENERATION(lease), SLOT_RESPONSE, LEASE_PID(lease));
+    if (wait_change(slot, request) != response) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "the server did not answer the owner of the slot");
+    }
+    int status = slot->status;
+    *value = slot->value_d;
+    if (!__atomic_compare_exchange_n(&slot->lease, &response, LEASE(LEASE_GENERATION(lease), SLOT_FREE, 0), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "the slot got reclaimed before the response was read");
+    }
+    return status;
+}
+
+static int raw_read(int pid, int pid_cmd, int info, int aggregates, int fields) {
+    int index = -1;
+    int value;
+    uint64_t lease = claim(&index);
+    struct request_slot *slot = &shm->slots[index];
+    write_read(slot, lease, pid);
+    slot->pid_cmd = pid_cmd;
+    slot->info = info;
+    slot->stats_aggregates = aggregates;
+    slot->stats_fields = fields;
+    slot->seal = request_seal(slot, LEASE(LEASE_GENERATION(lease), SLOT_REQUEST, LEASE_PID(lease)));
+    return serve(slot, lease, &value);
+}
+
+static void invalid_round(int pid) {
+    const struct {
+        const char *name;
+        int pid, pid_cmd, info, aggregates, fields;
+    } requests[] = {
+        {"aggregate of the command", -2, 0, 3, 0, 0},
+        {"aggregate that does not exist", -2, 4, 0, 0, 0},
+        {"stats without fields", -3, -1, 0, 15, 0},
+        {"stats without aggregates", -3, -1, 0, 0, 7},
+        {"stats of a field that does not exist", -3, -1, 0, 15, 8},
+        {"read of a field that does not exist", pid, -1, 5, 0, 0}
+    };
+    for (size_t i = 0; i < COUNT_OF(requests); ++i) {
+        int status = raw_read(requests[i].pid, requests[i].pid_cmd, requests[i].info, requests[i].aggregates, requests[i].fields);
+        if (status != STATUS_INVALID) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "%s got answered with status %d", requests[i].name, status);
+        }
+        printf("%s: invalid\n", requests[i].name);
+    }
+
+    struct procdb *db = procdb_connect(0);
+    if (db == NULL) {
+        bail_out(EXIT_FAILURE, "procdb_connect failed");
+    }
+    struct procdb_query queries[4];
+    memset(queries, 0, sizeof queries);
+    queries[0].type = PROCDB_QUERY_AGGREGATE;
+    queries[0].field = PROCDB_COMMAND;
+    queries[1].type = PROCDB_QUERY_STATS;
+    queries[1].aggregates = 1 << PROCDB_MIN;
+    queries[2].type = PROCDB_QUERY_FIELD;
+    queries[2].pid = pid;
+    queries[2].field = PROCDB_PID;
+    queries[3].type = PROCDB_QUERY_DISTINCT;
+    queries[3].field = PROCDB_CPU;
+    for (size_t i = 0; i < COUNT_OF(queries); ++i) {
+        errno = 0;
+        if (procdb_submit(db, &queries[i]) != -1 || errno != EINVAL) {
+            errno = 0;
+            bail_out(EXIT_FAILURE, "libprocdb sent invalid query %zu of type %d", i, queries[i].type);
+        }
+    }
+    procdb_disconnect(db);
+    printf("libprocdb refuses invalid queries\n");
+}
+
+static void stale_round(int pid, int seal) {
+    int index = -1;
+    uint64_t stale = claim(&index);
+    struct request_slot *slot = &shm->slots[index];
+    /* the client stops right after its compare and swap - the server has to take the slot back all the same */
+    if (LEASE_PID(wait_change(slot, stale)) != 0) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "slot %d of the stopped client got a new owner without being reclaimed", index);
+    }
+    uint64_t owner = claim(&index);
+    write_read(slot, owner, pid);
+    /* the stalled client wakes up and writes its delete over the read of the next owner */
+    slot->write_op = WRITE_DELETE;
+    slot->pid = pid;
+    if (seal) {
+        slot->seal = request_seal(slot, LEASE(LEASE_GENERATION(stale), SLOT_REQUEST, LEASE_PID(stale)));
+    }
+    uint64_t expected = stale;
+    if (__atomic_compare_exchange_n(&slot->lease, &expected, LEASE(LEASE_GENERATION(stale), SLOT_REQUEST, LEASE_PID(stale)), FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "the stalled client could still hand its request over");
+    }
+    int value;
+    int status = serve(slot, owner, &value);
+    if (status != STATUS_OVERWRITTEN) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "the overwritten request got served with status %d", status);
+    }
+    printf("stalled client %s its delete: slot %d reclaimed, request not served\n", seal ? "sealed" : "did not seal", index);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 0) {
+        progname = argv[0];
+    }
+    if (argc != 2) {
+        bail_out(EXIT_FAILURE, "usage: procdb-fault pid");
+    }
+    int pid = (int) strtol(argv[1], NULL, 10);
+    int shmfd = shm_open(SHM_SERVER, O_RDWR, PERMISSION);
+    if (shmfd == -1) {
+        bail_out(EXIT_FAILURE, "no server running");
+    }
+    shm = mmap(NULL, sizeof *shm, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    (void) close(shmfd);
+    if (shm == MAP_FAILED || __atomic_load_n(&shm->server_pid, __ATOMIC_ACQUIRE) == 0) {
+        bail_out(EXIT_FAILURE, "could not connect to the server");
+    }
+
+    /* an honest read first - the process has to be there */
+    int index = -1;
+    int value;
+    uint64_t lease = claim(&index);
+    write_read(&shm->slots[index], lease, pid);
+    if (serve(&shm->slots[index], lease, &value) != STATUS_OK || value == -1) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "process %d not found", pid);
+    }
+
+    invalid_round(pid);
+    stale_round(pid, TRUE);
+    stale_round(pid, FALSE);
+
+    /* none of the deletes may have happened */
+    index = -1;
+    lease = claim(&index);
+    write_read(&shm->slots[index], lease, pid);
+    if (serve(&shm->slots[index], lease, &value) != STATUS_OK || value == -1) {
+        errno = 0;
+        bail_out(EXIT_FAILURE, "process %d got deleted by the stalled client", pid);
+    }
+    printf("process %d is still there\n", pid);
+    (void) munmap(shm, sizeof *shm);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file procdb-hll-test.c
+ *
+ * @author Ulrike Schaefer 1327450
+ *
+ * @brief checks the error of the HyperLogLog sketches of procdb-server
+ *
+ * @details the standard error of an estimate is 1.04 / sqrt(HLL_REGISTERS) (0.81% for HLL_PRECISION 14). for several cardinalities from the empty set to millions of values every trial has to stay within HLL_MAX_ERRORS standard errors, the root mean square error of the trials within HLL_MAX_RMS standard errors and the mean error (the bias) within HLL_MAX_BIAS standard errors. merged sketches of overlapping time windows have to be the sketch of the union and estimate it just as well. the hashes are fixed, so every run sees the same estimates.
+ *
+ * @date 18.10.2026
+ *
+ */
+
+#include <math.h>
+
+#include "procdb.h"
+#include "procdb-hll.h"
+
+/**
+ * @brief most standard errors a single estimate may be off
+ */
+#define HLL_MAX_ERRORS (4.0)
+
+/**
+ * @brief most standard errors the root mean square error of the trials may be
+ */
+#define HLL_MAX_RMS (1.5)
+
+/**
+ * @brief most standard errors the mean error of the trials may be
+ */
+#define HLL_MAX_BIAS (1.0)
+
+/**
+ * @brief number of windows of the windowed test and number of values that start in every window
+ */
+#define TEST_WINDOWS (60)
+#define TEST_WINDOW_VALUES (2000)
+
+/**
+ * @brief standard error of an estimate
+ */
+static double standard_error;
+
+/**
+ * @brief number of failed checks
+ */
+static int failed = 0;
+
+/**
+ * @brief sketches of the tests - too big for the stack
+ */
+static struct hll sketch;
+static struct hll merged;
+static struct hll direct;
+static struct hll windows[TEST_WINDOWS];
+
+/**
+ * @brief value of a trial - the trials count disjoint sets of values
+ * @param trial number of the trial
+ * @param i number of the value in the trial
+ * @param strings TRUE to hash a command line instead of an int
+ * @return hash of the value
+ */
+static uint64_t value_hash(int trial, int i, int strings);
+
+/**
+ * @brief checks the error of the estimates of a cardinality
+ * @param n cardinality
+ * @param trials number of sets of n values to estimate
+ * @param strings TRUE to count command lines instead of ints
+ */
+static void check_cardinality(int n, int trials, int strings);
+
+/**
+ * @brief checks merges of the sketches of overlapping time windows - like the windows of a distinct request
+ */
+static void check_windows(void);
+
+/**
+ * @brief records a failed check
+ * @param what what failed
+ */
+static void fail(const char *what);
+
+
+static uint64_t value_hash(int trial, int i, int strings) {
+    if (!strings) {
+        return hll_hash_int(trial * 20000000 + i);
+    }
+    char command[64];
+    int length = snprintf(command, sizeof command, "/usr/bin/proc-%d --id %d", trial, i);
+    return hll_hash(command, (size_t) length);
+}
+
+static void fail(const char *what) {
+    printf("FAIL %s\n", what);
+    ++failed;
+}
+
+static void check_cardinality(int n, int trials, int strings) {
+    double squares = 0.0;
+    double sum = 0.0;
+    double worst = 0.0;
+    for (int trial = 0; trial < trials; ++trial) {
+        hll_clear(&sketch);
+        for (int i = 0; i < n; ++i) {
+            hll_add(&sketch, value_hash(trial, i, strings));
+        }
+        double estimate = hll_estimate(&sketch);
+        if (n == 0) {
+            if (estimate >= 0.5) {
+                fail("the empty set does not estimate 0");
+            }
+            continue;
+        }
+        /* a small set can only be off by whole values - one of them is allowed on top */
+        double error = (estimate - n) / n;
+        double allowed = HLL_MAX_ERRORS * standard_error + 1.0 / n;
+        if (fabs(error) > allowed) {
+            char what[128];
+            (void) snprintf(what, sizeof what, "n=%d trial %d is off by %.3f%%", n, trial, 100.0 * error);
+            fail(what);
+        }
+        squares += error * error;
+        sum += error;
+        if (fabs(error) > worst) {
+            worst = fabs(error);
+        }
+    }
+    if (n == 0) {
+        printf("n=0%s estimates 0\n", strings ? " strings" : "");
+        return;
+    }
+    double rms = sqrt(squares / trials);
+    double bias = sum / trials;
+    printf("n=%d%s: rms %.3f%%, bias %.3f%%, worst %.3f%% (standard error %.3f%%)\n", n, strings ? " strings" : "", 100.0 * rms, 100.0 * bias,
+        100.0 * worst, 100.0 * standard_error);
+    if (rms > HLL_MAX_RMS * standard_error + 1.0 / n) {
+        fail("root mean square error too big");
+    }
+    if (fabs(bias) > HLL_MAX_BIAS * standard_error + 1.0 / n) {
+        fail("estimates are biased");
+    }
+}
+
+static void check_windows(void) {
+    /* every window sees the values that started in it and the ones of the two windows before - like processes that live for three windows */
+    for (int w = 0; w < TEST_WINDOWS; ++w) {
+        hll_clear(&windows[w]);
+        int first = (w < 2 ? 0 : w - 2) * TEST_WINDOW_VALUES;
+        for (int i = first; i < (w + 1) * TEST_WINDOW_VALUES; ++i) {
+            hll_add(&windows[w], hll_hash_int(i));
+        }
+    }
+    const int lasts[] = {1, 5, 15, TEST_WINDOWS};
+    for (size_t l = 0; l < sizeof lasts / sizeof lasts[0]; ++l) {
+        int last = lasts[l];
+        hll_clear(&merged);
+        for (int w = TEST_WINDOWS - 1; w >= TEST_WINDOWS - last; --w) {
+            hll_merge(&merged, &windows[w]);
+        }
+        int first = TEST_WINDOWS - last < 2 ? 0 : TEST_WINDOWS - last - 2;
+        int n = (TEST_WINDOWS - first) * TEST_WINDOW_VALUES;
+        hll_clear(&direct);
+        for (int i = first * TEST_WINDOW_VALUES; i < TEST_WINDOWS * TEST_WINDOW_VALUES; ++i) {
+            hll_add(&direct, hll_hash_int(i));
+        }
+        /* a value seen in several windows counts once - the merge is exactly the sketch of the union */
+        if (memcmp(&merged, &direct, sizeof merged) != 0) {
+            fail("merged windows differ from the sketch of their union");
+        }
+        double estimate = hll_estimate(&merged);
+        double error = (estimate - n) / n;
+        printf("last %d windows: %d distinct values, estimate %.0f (%.3f%%)\n", last, n, estimate, 100.0 * error);
+        if (fabs(error) > HLL_MAX_ERRORS * standard_error) {
+            fail("merged windows estimate too far off");
+        }
+    }
+    /* merging again changes nothing */
+    struct hll *again = &direct;
+    *again = merged;
+    hll_merge(again, &merged);
+    hll_merge(again, &windows[TEST_WINDOWS - 1]);
+    if (memcmp(again, &merged, sizeof merged) != 0) {
+        fail("merging a sketch into itself changes it");
+    }
+}
+
+int main(void) {
+    standard_error = 1.04 / sqrt(HLL_REGISTERS);
+    const int small[] = {0, 1, 2, 10, 100, 1000};
+    for (size_t i = 0; i < sizeof small / sizeof small[0]; ++i) {
+        check_cardinality(small[i], 30, FALSE);
+    }
+    check_cardinality(10000, 30, FALSE);
+    check_cardinality(40000, 30, FALSE);
+    check_cardinality(100000, 20, FALSE);
+    check_cardinality(1000000, 5, FALSE);
+    check_cardinality(100, 30, TRUE);
+    check_cardinality(200000, 10, TRUE);
+    check_windows();
+    if (failed != 0) {
+        printf("%d checks failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    printf("all estimates within the bounds\n");
+    return EXIT_SUCCESS;
+}